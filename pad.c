@@ -3,10 +3,209 @@
 **
 ** Peek in the address space of a running process.
 **
-** Usage:  pad  pid  [hexaddress  [numbytes]]
+** Usage:  pad  [--live|--consistent]  [--all|--swapin]  [-o path]
+**              [--format hex|raw|core]  [--search pattern]
+**              [--track|--delta]  [--base path]
+**              [--diff  [--interval seconds]]  [--jobs n]
+**              [--only heap|stack|anon|file|pattern,...]  [--perm rwxps]
+**              [--annotate]  [--pointers]  [--heap]  [--classify[=map]]
+**              [--strings minlen]  [-z|--compress[=lines]]
+**              pid  [hexaddress  [numbytes]]
+**
+**         pad  [--live|--consistent]  [--search pattern|--strings minlen]
+**              [--tree]  [-o path]  pid[,pid...]
+**
+**         pad  --diff  [-o path]  snapshot  snapshot
+**
+**         pad  --watch  [--every time]  [--summary]  [-o path]
+**              pid  hexaddress  [numbytes]
+**
+**         pad  --dedup-report  [--live|--consistent]  [-o path]  pid ...
+**
+**         pad  --summary  [-o path]  pid
+**
+** By default the target process is stopped (ptrace) during the whole
+** dump and its memory is read via /proc/pid/mem.
+**
+**   --live		read with process_vm_readv without ever stopping
+**			the target (the dump is not a consistent snapshot)
+**   --consistent	stop all threads of the target only while its
+**			memory is copied with process_vm_readv to a
+**			temporary file in $TMPDIR (default /var/tmp), and
+**			dump the copy after the target has been resumed
+**
+** Every area is read in chunks via one reusable buffer, so the memory
+** usage of pad does not depend on the size of the target. Pages that
+** can not be read are reported as one line per contiguous range.
+**
+** When all areas are dumped, special areas ([vvar], [vsyscall] and
+** device mappings with VmFlags io or pf) are skipped and the areas
+** can be selected with:
+**
+**   --only types	comma-separated list of area types: heap, stack,
+**			anon (no name), file (file-backed) or a pattern
+**			that matches the name (part of the name, or shell
+**			wildcards for the whole name); special areas are
+**			only dumped when a pattern matches them explicitly
+**   --perm perms	only areas with all given permissions (e.g. rw)
+**
+** When all areas are dumped, /proc/pid/pagemap is used to read only
+** the pages that are resident in memory: ranges of pages that were
+** never touched or that are swapped out are reported as one line,
+** just like ranges of pages that only contain zero bytes.
+**
+**   --all		read and dump all pages, also non-resident pages
+**			(which are faulted in) and pages with zeroes
+**   --swapin		also read pages that are swapped out (they are
+**			faulted in)
+** Lines are formatted via lookup tables into a large output buffer
+** that is flushed with write().
+**
+**   -z, --compress	show a line that repeats the previous line as one
+**			line with '*' (like hexdump) and write the output
+**			as an LZ4 frame (read with lz4 -d or lz4cat),
+**			compressed per flushed buffer by a built-in
+**			compressor; not to a terminal
+**   --compress=lines	only show repeated lines as '*' (plain text)
+**
+**   --annotate	label every line in which a symbol starts, and every
+**			8-byte aligned word that points into a mapped area
+**			with the symbol (from .symtab/.dynsym of the mapped
+**			ELF files) or the area and offset it points to, e.g.
+**			<main_arena>  [+8]=libc.so.6:main_arena+0x60
+**   --jobs n		read and format large areas with n threads, each
+**			handling pieces of JOBCHUNK bytes; formatted pieces
+**			are written in address order, so the output is the
+**			same as with one thread (also used for raw and core
+**			output, where every thread writes at its own offset)
+**
+**   --format hex	hexadecimal and character lines (default) written
+**			to standard output or to the file given with -o
+**   --format raw	binary contents of every area written with pwrite
+**			(unreadable pages and pages with zeroes remain
+**			holes); when -o names a
+**			directory (default: pad.<pid>) every area gets its
+**			own file, otherwise all areas are concatenated in
+**			one file; the index (directory/index or file.index)
+**			contains per area: start-end perms file offset name
+**   --format core	ELF core file (default: core.<pid>) that can be
+**			opened with gdb, with the registers of all threads
+**			that were stopped by pad
+**
+**   --search pattern	only show the addresses where the pattern occurs
+**			with one line of context before and after; the
+**			pattern is a string, or hex bytes after "x:" in
+**			which a '?' matches any nibble (x:de?dbe??), or
+**			hex bytes with a mask (x:deadbeef/ffff00ff)
+**
+**   --strings minlen	only show the runs of at least minlen printable
+**			characters (like strings), as ASCII (a) or as
+**			UTF-16LE at even addresses (u), with their address
+**			and the name of their area; strings that cross
+**			chunk boundaries are shown as one string
+**
+**   --track		clear the soft-dirty bits of all pages of the
+**			target and save its resident pages as baseline
+**			(raw format) in the base file (default:
+**			pad.<pid>.base)
+**   --delta		only read the pages that have been written since
+**			--track (soft-dirty bit in pagemap) and show the
+**			lines that differ from the baseline as pairs of
+**			'-' (baseline) and '+' (current) lines
+**
+**   --diff		compare two raw snapshots (written with --format
+**			raw, which also saves a hash of every page), or
+**			take a snapshot of the running target, wait for
+**			--interval seconds (default 1) and take another
+**			one; per area the ranges of bytes that changed
+**			are reported, pages with equal hashes are not
+**			compared at all
+**
+**   --watch		read the given range of the running target every
+**			--every time (seconds, or with suffix ms or us;
+**			more than 0, default 1s) with process_vm_readv,
+**			without ever stopping it, and show the lines that
+**			changed as pairs of '-' (previous) and '+' (current)
+**			lines after the time of the sample; with --summary
+**			only the number of changes and the time of the last
+**			change per line are shown when watching is ended
+**			by an interrupt or when the range can not be read
+**
+**   --summary		only show the areas with their sizes (KiB) and
+**			flags from /proc/pid/smaps without reading memory
+**
+**   --dedup-report	hash every resident page of one or more processes,
+**			group pages with identical contents and report per
+**			area and per mapping name how much memory could be
+**			saved by sharing duplicates (e.g. by KSM, which only
+**			merges private anonymous pages) and by mapping pages
+**			with zeroes to the zero page
+**
+**   --pointers		scan every aligned word of the writable areas and
+**			the registers for values that point into a mapped
+**			area; report the number of pointers from and into
+**			every area and per class of areas (heap, stack,
+**			anon, file), walk the chunks of the malloc heap and
+**			follow the pointers from the registers and other
+**			areas through the blocks in use to list the blocks
+**			that can not be reached (leak candidates, largest
+**			first, with their first bytes); all areas are
+**			scanned, --only and --perm only select the areas
+**			and heap blocks that are reported
+**
+**   --heap		walk the chunks of the glibc malloc heaps ([heap] of
+**			the main arena, the mmapped heaps of the other arenas
+**			and chunks mmapped on their own) and report per arena
+**			the chunks in use and free (free chunks in tcaches
+**			and fastbins are counted as free), the size of the
+**			top chunk, the largest free chunk (bytes) and the
+**			fragmentation (share of free memory outside the
+**			largest free chunk), a histogram of chunk sizes and
+**			the largest free chunks
+**
+**   --classify		classify every resident page as zero, text
+**			(printable characters), pointers (at least 25% of
+**			the aligned words point into an area), random
+**			(compressed or encrypted: entropy of at least 7.2
+**			bits per byte), repeating (pattern of at most 64
+**			bytes) or binary, and show per area the number of
+**			pages per class, the mean entropy and the size of
+**			the pages when compressed (estimated from the
+**			entropy), to judge e.g. how well zswap would work
+**   --classify=map	show a map with one character per page instead
+**
+** Several processes can be dumped, searched or scanned for strings at
+** once by a comma-separated list of pids, or by one pid with --tree to
+** add all its descendants. Every process gets its own header. When the
+** physical page numbers are visible in pagemap (CAP_SYS_ADMIN), pages
+** that are mapped to a physical page that was already shown for one of
+** the previous processes (e.g. after fork, or shared libraries) are
+** reported as one line per range instead of being shown again, and a
+** table shows per process the resident memory and how much of it is
+** private and shared with the other processes.
+**
+**   --tree		also dump all descendants of the given process
 ** ==================================================================
 ** Author:  Gerlof Langeveld        (2018)
 ** Copyright (C) 2018  AT Computing BV
+** Modified: 2026 - live and consistent access via process_vm_readv
+**                  raw and ELF core output formats
+**                  pattern search
+**                  pagemap-aware dumping of resident pages
+**                  soft-dirty tracking and delta dumps
+**                  snapshot diffs with page hashes
+**                  duplicate page report
+**                  full smaps parsing and area summary
+**                  parallel reading and formatting
+**                  selection of areas
+**                  symbol annotation
+**                  pointer graph and leak candidates
+**                  malloc heap report
+**                  watch mode
+**                  content classification
+**                  string extraction
+**                  several processes with shared pages shown once
+**                  compressed output
 ** ==================================================================
 ** This file is free software.  You can redistribute it and/or modify
 ** it under the terms of the GNU General Public License (GPL); either
@@ -14,6 +213,7 @@
 */
 
 #define	__FILE_OFFSET_BITS	64
+#define	_GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -24,54 +224,579 @@
 #include <ctype.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <elf.h>
+#include <sys/procfs.h>
+#include <math.h>
 
 
 #define	BYTESPERLINE	16
-#define	MAXAR		1024
+#define	CHUNKSIZE	(1024*1024)
+#define	JOBCHUNK	(CHUNKSIZE/4)	// piece of an area per thread (--jobs)
+#define	OUTBUFSIZE	(4*1024*1024)
+#define	MAXLINE		(24 + BYTESPERLINE*4 + 4)	// one formatted line
+#define	MAXTASK		65536
+
+#ifndef	IOV_MAX
+#define	IOV_MAX		1024
+#endif
 
+#if	defined(__x86_64__)
+#define	ELF_MACHINE	EM_X86_64
+#elif	defined(__aarch64__)
+#define	ELF_MACHINE	EM_AARCH64
+#elif	defined(__powerpc64__)
+#define	ELF_MACHINE	EM_PPC64
+#elif	defined(__s390x__)
+#define	ELF_MACHINE	EM_S390
+#else
+#define	ELF_MACHINE	EM_NONE
+#endif
+
+/*
+** virtual memory areas (table grows with the number of areas) with
+** the properties from /proc/pid/smaps (sizes in KiB)
+*/
 struct arange {
 	void		*start;
 	long long	length;
-	char		name[128];
+	char		*name;		// full name (empty for anonymous)
 	char		perm[16];
-} ar[MAXAR];
+	long long	offset;		// offset in mapped file
+	long long	rss, pss, swap, anonhuge;
+	char		vmflags[96];
+	long long	snapoff;	// offset in snapshot file (consistent)
+	unsigned char	*snapok;	// bitmap of pages in snapshot file
+	unsigned char	*pstate;	// page states during snapshot
+	unsigned long long *pme;	// pagemap entries during snapshot
+					// (several processes)
+} *ar;
 
-char *usage = "Usage: pad  pid  [hexaddress  [numbytes]]\n";
+int	maxar;				// allocated entries of ar
+
+/*
+** ways to access the memory of the target process
+*/
+#define	ACC_PTRACE	0	// stopped during dump, read /proc/pid/mem
+#define	ACC_LIVE	1	// never stopped, read via process_vm_readv
+#define	ACC_CONSIST	2	// stopped while copying via process_vm_readv
+
+/*
+** output formats
+*/
+#define	FMT_HEX		0
+#define	FMT_RAW		1
+#define	FMT_CORE	2
+
+char *usage = "Usage: pad  [--live|--consistent]  [--all|--swapin]  [-o path]\n"
+              "            [--format hex|raw|core]  [--search pattern]\n"
+              "            [--track|--delta]  [--base path]\n"
+              "            [--diff  [--interval seconds]]  [--jobs n]\n"
+              "            [--only heap|stack|anon|file|pattern,...]  [--perm rwxps]\n"
+              "            [--annotate]  [--pointers]  [--heap]  [--classify[=map]]\n"
+              "            [--strings minlen]  [-z|--compress[=lines]]\n"
+              "            pid  [hexaddress  [numbytes]]\n"
+              "       pad  [--live|--consistent]  [--search pattern|--strings minlen]\n"
+              "            [--tree]  [-o path]  pid[,pid...]\n"
+              "       pad  --diff  [-o path]  snapshot  snapshot\n"
+              "       pad  --watch  [--every time]  [--summary]  [-o path]\n"
+              "            pid  hexaddress  [numbytes]\n"
+              "       pad  --dedup-report  [--live|--consistent]  [-o path]  pid ...\n"
+              "       pad  --summary  [-o path]  pid\n";
 char dumpall = 1;
+char accmode  = ACC_PTRACE;
+char format   = FMT_HEX;
+char *outpath;
+char allpages;
+char swapin;
+char track;
+char delta;
+char *basepath;
+char diff;
+int  njobs = 1;
+char *onlytypes;
+char *onlyperms;
+char annotate;
+char pointers;
+char heap;
+char watch;
+char tree;
+char squeeze;			// collapse repeated lines
+char compress;			// LZ4 frame output
+char classmode;			// 1: summary per area, 2: map
+long minstr;			// minimum length of strings
+long long nstrings;
+char dedup;
+char showsum;
+double interval = 1.0;
+long pagesize;
+
+long long	pid;
+int		memfd  = -1;		// /proc/pid/mem (ptrace mode)
+int		snapfd = -1;		// snapshot file (consistent mode)
+__thread unsigned char	*chunkbuf;	// reusable read buffer (per thread)
+int		pmfd   = -1;		// /proc/pid/pagemap
+
+/*
+** state of a page (from pagemap) and kinds of ranges that are not
+** passed as data while walking through an area
+*/
+#define	PG_READ		0	// resident (or unknown): read it
+#define	PG_UNREADABLE	1
+#define	PG_ABSENT	2	// never touched or not in page table
+#define	PG_SWAPPED	3
+#define	PG_ZERO		4	// read, but only zero bytes
+#define	PG_CLEAN	5	// not written since --track (delta)
+#define	PG_SHARED	6	// physical page shown before (several pids)
+
+char	*pgtext[] = { "", "not readable", "not resident", "swapped out",
+		      "zero", "not changed", "shared (shown before)" };
+
+#define	PM_PRESENT	(1ULL << 63)
+#define	PM_SWAP		(1ULL << 62)
+#define	PM_SOFTDIRTY	(1ULL << 55)
+#define	PM_PFN		((1ULL << 55) - 1)
+
+__thread unsigned long long *pmbuf;	// pagemap entries of one chunk
+__thread long long	pmfirst;	// page of pmbuf[0]
+__thread long		pmpages;	// valid entries in pmbuf
+unsigned long long	zerohash;	// hash of a page with zeroes
+
+/*
+** output buffer for standard output and formatting tables
+** (threads of --jobs format into their own buffer)
+*/
+struct outbuf {
+	char	*buf;
+	long	len;
+	int	fd;
+	long	size;
+};
+
+__thread struct outbuf	out = { NULL, 0, 1, OUTBUFSIZE };
+
+char	hexpair[256][2];		// byte value -> two hex digits
+char	printable[256];			// byte value -> character column
+
+/*
+** threads of the target that are stopped (consistent mode)
+*/
+struct task {
+	pid_t		tid;
+	int		sig;	// pending signal to be delivered on detach
+	int		hasregs;
+	elf_gregset_t	regs;	// registers while stopped
+} tasks[MAXTASK];
+
+int ntasks;
+char frozen;			// threads stopped by freezeproc
+
+struct proc	*procs;		// several processes (pid,pid... or --tree)
 
-static void	dumparea(int, long long, long long, int);
+/*
+** search pattern: bytes with a mask of significant bits per byte and
+** the longest run of fully significant bytes (anchor) that is located
+** with memmem before the remaining bytes are compared
+*/
+#define	MAXPAT		256
+
+struct pattern {
+	unsigned char	byte[MAXPAT];
+	unsigned char	mask[MAXPAT];
+	int		len;
+	int		anchor, anchorlen;
+	unsigned char	tail[MAXPAT*2];	// end of previous chunk + start of next
+	long long	tailaddr;
+	int		taillen;
+	long long	nmatch;
+} *search;
+
+typedef void	datafunc(struct arange *, long long, unsigned char *, long,
+								void *);
+typedef void	holefunc(struct arange *, long long, long long, int, void *);
+
+static void	dumparea(struct arange *);
+static datafunc	dumpchunk;
+static holefunc	dumphole;
 static void	dumpline(long long, unsigned char *, int);
+static void	outinit(void);
+static void	outflush(void);
+static void	outroom(long);
+static void	outwrite(char *, long);
+static void	fdwrite(char *, long);
+static void	lz4end(void);
+static void	outprintf(const char *, ...);
 static void	detachproc(int);
-static int	getaddranges(long, struct arange [], int);
+static int	getaddranges(long, struct arange **, int *);
+static int	readareas(long, struct arange **, int *);
+static void	summary(struct arange [], int);
+static int	selectareas(struct arange [], int, int);
+static int	selectarea(struct arange *);
+static void	loadsymbols(long);
+static void	annotline(long long, unsigned char *, int);
+static void	ptrreport(struct arange [], int);
+static void	heapreport(struct arange [], int);
+static void	classify(struct arange [], int, int);
+static long	memread(struct arange *, long long, unsigned char *, long);
+static long	vmread(long, long long, unsigned char *, long);
+static long	snapread(struct arange *, long long, unsigned char *, long);
+static void	walkarea(struct arange *, datafunc *, holefunc *, void *, int);
+static void	walkrange(struct arange *, long long, long long, datafunc *,
+						holefunc *, void *, int);
+static void	parwalk(struct arange *, datafunc *, holefunc *, void *, int,
+									int);
+static int	pagerun(struct arange *, long long, long *);
+static void	pagestates(struct arange *);
+static int	clearrefs(long);
+static void	writedelta(char *, struct arange [], int);
+static void	diffsnaps(char *, char *);
+static void	livediff(struct arange [], int, double);
+static void	watchrange(long long, long long);
+static unsigned long long pagehash(unsigned char *, long);
+static int	attachproc(long);
+static void	releaseproc(long, struct arange [], int);
+static void	dedupreport(int, char *[]);
+static int	pfnkind(unsigned long long, int);
+static void	pfnshown(struct arange *, long long, long long);
+static int	addtree(long, long **, int, int *);
+static long	parentof(long);
+static int	ownproc(long);
+static void	multidump(int, long []);
+static void	showareas(struct arange [], int);
+static int	freezeproc(long);
+static void	thawproc(void);
+static void	snapshot(long, struct arange [], int);
+static void	getregs(struct task *);
+static void	writeraw(char *, struct arange [], int);
+static void	writecore(char *, struct arange [], int);
+static datafunc	filechunk;
+static holefunc	skiphole;
+static struct pattern *parsepattern(char *);
+static void	searcharea(struct arange *);
+static void	stringsarea(struct arange *);
 
 int
 main(int argc, char *argv[])
 {
-	char 		fname[1000], line[128], *p;
-	unsigned char 	*buf;
-	int		memfd;
-	long long	pid, address, length;
-	int		i, n;
+	char 		fname[1000], bname[1000], *p, *e;
+	struct stat	st;
+	long long	address, length;
+	long		*pids = NULL;
+	int		c, nar, npids = 0, maxpids = 0;
+
+	static struct option	longopts[] = {
+		{ "live",	no_argument,		NULL,	'l' },
+		{ "consistent",	no_argument,		NULL,	'c' },
+		{ "format",	required_argument,	NULL,	'f' },
+		{ "output",	required_argument,	NULL,	'o' },
+		{ "search",	required_argument,	NULL,	's' },
+		{ "all",	no_argument,		NULL,	'a' },
+		{ "swapin",	no_argument,		NULL,	'w' },
+		{ "track",	no_argument,		NULL,	't' },
+		{ "delta",	no_argument,		NULL,	'd' },
+		{ "base",	required_argument,	NULL,	'b' },
+		{ "diff",	no_argument,		NULL,	'D' },
+		{ "interval",	required_argument,	NULL,	'i' },
+		{ "dedup-report", no_argument,		NULL,	'R' },
+		{ "summary",	no_argument,		NULL,	'm' },
+		{ "jobs",	required_argument,	NULL,	'j' },
+		{ "only",	required_argument,	NULL,	'O' },
+		{ "perm",	required_argument,	NULL,	'P' },
+		{ "annotate",	no_argument,		NULL,	'A' },
+		{ "pointers",	no_argument,		NULL,	'p' },
+		{ "heap",	no_argument,		NULL,	'H' },
+		{ "watch",	no_argument,		NULL,	'W' },
+		{ "every",	required_argument,	NULL,	'e' },
+		{ "classify",	optional_argument,	NULL,	'C' },
+		{ "strings",	required_argument,	NULL,	'S' },
+		{ "tree",	no_argument,		NULL,	'T' },
+		{ "compress",	optional_argument,	NULL,	'z' },
+		{ 0,		0,			NULL,	0   },
+	};
+
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	// flag verification
+	//
+	while ( (c = getopt_long(argc, argv, "o:j:z", longopts, NULL)) != EOF) {
+		switch (c) {
+		   case 'l':
+			accmode = ACC_LIVE;
+			break;
+
+		   case 'c':
+			accmode = ACC_CONSIST;
+			break;
+
+		   case 'f':
+			if (strcmp(optarg, "hex") == 0)
+				format = FMT_HEX;
+			else if (strcmp(optarg, "raw") == 0)
+				format = FMT_RAW;
+			else if (strcmp(optarg, "core") == 0)
+				format = FMT_CORE;
+			else {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid format\n");
+				exit(1);
+			}
+			break;
+
+		   case 'o':
+			outpath = optarg;
+			break;
+
+		   case 'a':
+			allpages = 1;
+			break;
+
+		   case 'w':
+			swapin = 1;
+			break;
+
+		   case 't':
+			track = 1;
+			break;
+
+		   case 'd':
+			delta = 1;
+			break;
+
+		   case 'b':
+			basepath = optarg;
+			break;
+
+		   case 'D':
+			diff = 1;
+			break;
+
+		   case 'R':
+			dedup = 1;
+			break;
+
+		   case 'm':
+			showsum = 1;
+			break;
+
+		   case 'O':
+			onlytypes = optarg;
+			break;
+
+		   case 'A':
+			annotate = 1;
+			break;
+
+		   case 'p':
+			pointers = 1;
+			break;
+
+		   case 'H':
+			heap = 1;
+			break;
+
+		   case 'W':
+			watch = 1;
+			break;
+
+		   case 'T':
+			tree = 1;
+			break;
+
+		   case 'z':
+			squeeze = 1;
+
+			if (!optarg)
+				compress = 1;
+			else if (strcmp(optarg, "lines") != 0) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid compression\n");
+				exit(1);
+			}
+			break;
+
+		   case 'C':
+			if (!optarg)
+				classmode = 1;
+			else if (strcmp(optarg, "map") == 0)
+				classmode = 2;
+			else {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid classify output\n");
+				exit(1);
+			}
+			break;
+
+		   case 'P':
+			if (strspn(optarg, "rwxps") != strlen(optarg)) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid permissions\n");
+				exit(1);
+			}
+
+			onlyperms = optarg;
+			break;
+
+		   case 'S':
+			minstr = strtol(optarg, &p, 10);
+
+			if (*p || minstr < 1) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid minimum string length\n");
+				exit(1);
+			}
+			break;
+
+		   case 'j':
+			njobs = strtol(optarg, &p, 10);
+
+			if (*p || njobs < 1) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid number of jobs\n");
+				exit(1);
+			}
+			break;
+
+		   case 'i':
+		   case 'e':
+			interval = strtod(optarg, &p);
+
+			// optional unit
+			//
+			if (strcmp(p, "ms") == 0) {
+				interval /= 1000;
+				p += 2;
+			} else if (strcmp(p, "us") == 0) {
+				interval /= 1000000;
+				p += 2;
+			} else if (strcmp(p, "s") == 0) {
+				p++;
+			}
+
+			// watching without pause would only poll
+			//
+			if (*p || interval < 0 || (c == 'e' && interval == 0)) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid interval\n");
+				exit(1);
+			}
+			break;
+
+		   case 's':
+			if ( (search = parsepattern(optarg)) == NULL) {
+				fprintf(stderr, usage);
+				fprintf(stderr, "invalid search pattern\n");
+				exit(1);
+			}
+			break;
+
+		   default:
+			fprintf(stderr, usage);
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if ( (chunkbuf = malloc(CHUNKSIZE)) == NULL ||
+	     (pmbuf = malloc((CHUNKSIZE / pagesize + 2) * sizeof *pmbuf)) == NULL) {
+		perror("Can't allocate read buffer");
+		exit(1);
+	}
+
+	// compressed output only for the hexadecimal output stream,
+	// and not to a terminal
+	//
+	if (compress && format != FMT_HEX) {
+		fprintf(stderr, "compression only for hexadecimal output\n");
+		exit(1);
+	}
+
+	if (compress && !outpath && isatty(1)) {
+		fprintf(stderr, "compressed output not written to a terminal\n");
+		exit(1);
+	}
+
+	outinit();
+
+	memset(chunkbuf, 0, pagesize);
+	zerohash = pagehash(chunkbuf, pagesize);
 
 	// argument verification
 	//
-	if (argc < 2 || argc > 4) {
+	if (argc < 2 || (argc > 4 && !dedup)) {
 		fprintf(stderr, usage);
 		exit(1);
 	}
 
-	// argument conversion
+	// hexadecimal output to file
+	//
+	if (outpath && format == FMT_HEX && !track) {
+		if ( (out.fd = open(outpath, O_WRONLY|O_CREAT|O_TRUNC,
+							0644)) == -1) {
+			perror(outpath);
+			exit(1);
+		}
+	}
+
+	// compare two snapshots (no process involved): both operands
+	// exist as snapshot, otherwise they are a pid and an address
+	//
+	if (diff && argc == 3 && stat(argv[1], &st) == 0 &&
+	                         stat(argv[2], &st) == 0) {
+		diffsnaps(argv[1], argv[2]);
+		exit(0);
+	}
+
+	// duplicate pages in one or more processes
+	//
+	if (dedup) {
+		dedupreport(argc - 1, argv + 1);
+		exit(0);
+	}
+
+	// a live diff requires the target to run between the snapshots,
+	// a watched range is read while the target runs
 	//
-        pid = strtoll(argv[1], &p, 10);
+	if (diff || watch)
+		accmode = ACC_LIVE;
 
-	if (*p) {
+	// argument conversion: one or more pids (and their descendants)
+	//
+	for (p = argv[1]; *p; p = *e ? e + 1 : e) {
+        	pid = strtoll(p, &e, 10);
+
+		if (e == p || (*e && *e != ',')) {
+			fprintf(stderr, usage);
+			fprintf(stderr, "invalid pid value\n");
+			exit(1);
+		}
+
+		npids = addtree(pid, &pids, npids, &maxpids);
+	}
+
+	if (npids == 0) {
 		fprintf(stderr, usage);
 		fprintf(stderr, "invalid pid value\n");
 		exit(1);
 	}
 
+	pid = pids[0];
+
 	if (argc > 2) {
-		dumpall = 0;
+		dumpall  = 0;
+		allpages = 1;	// explicitly requested range: read everything
+
         	address = strtoll(argv[2], &p, 16);
 
 		if (*p) {
@@ -93,176 +818,5564 @@ main(int argc, char *argv[])
 		}
 	}
 
-	// attach target process: required to be able to read memory
+	// several processes: one after another
 	//
-        if (ptrace(PTRACE_ATTACH, pid, NULL, NULL) == -1) {
-            perror("Attach to specified pid");
-            exit(1);
-        }
+	if (npids > 1) {
+		if (!dumpall || format != FMT_HEX || track || delta || diff ||
+		    watch || showsum || annotate || pointers || heap ||
+		    classmode) {
+			fprintf(stderr, usage);
+			fprintf(stderr, "several processes can only be dumped, "
+					"searched or scanned for strings\n");
+			exit(1);
+		}
 
-        (void) wait(NULL);
+		multidump(npids, pids);
+		exit(0);
+	}
 
-	// open memory of target process
+	// watch a range of the running target
 	//
-        snprintf(fname, sizeof fname, "/proc/%d/mem", pid);
+	if (watch) {
+		if (dumpall) {
+			fprintf(stderr, usage);
+			fprintf(stderr, "address required to watch\n");
+			exit(1);
+		}
 
-        if ( (memfd = open(fname, O_RDONLY)) == -1) {
-        	perror("Open memory of process");
-		detachproc(pid);
-		exit(1);
-        }
+		watchrange(address, length);
+		outflush();
+		exit(0);
+	}
 
-	if (dumpall) {
-		int nar;
+	// summary of areas (memory is not read)
+	//
+	if (showsum) {
+		if ( (nar = getaddranges(pid, &ar, &maxar)) == -1)
+			exit(1);
 
-		// determine all address ranges of this process
-		//
-		if ( (nar = getaddranges(pid, ar, MAXAR)) == -1) {
-	            	exit(1);
-        	}
+		summary(ar, nar);
+		exit(0);
+	}
 
-		// dump address ranges one-by-one
-		//
-		for (i=0; i < nar; i++) {
-			printf("------------  perms=%s  vsize=%lldKiB  %s\n",
-				ar[i].perm, ar[i].length/1024, ar[i].name);
+	if (attachproc(pid) == -1)
+		exit(1);
 
-			dumparea(memfd, pid,
-				(long long)ar[i].start, ar[i].length);
+	// index of all areas and their symbols to label addresses
+	//
+	if (annotate)
+		loadsymbols(pid);
 
-			printf("\n");
-		}
-	} else {
-		dumparea(memfd, pid, address, length);
+	// start tracking of written pages before the baseline is read
+	//
+	if (track && clearrefs(pid) == -1) {
+		releaseproc(pid, ar, 0);
+		exit(1);
 	}
 
-	(void) close(memfd);
-
-	// detach process
+	// determine address ranges to be dumped: all address ranges
+	// of this process or the requested range (the pointer graph
+	// scans all areas, --only and --perm select what is reported)
 	//
-	detachproc(pid);
-}
+	if (dumpall) {
+		if ( (nar = readareas(pid, &ar, &maxar)) == -1) {
+			releaseproc(pid, ar, 0);
+	            	exit(1);
+        	}
 
+		nar = selectareas(ar, nar, pointers);
+	} else {
+		if ( (ar = calloc(1, sizeof *ar)) == NULL) {
+			perror("Can't allocate area");
+			releaseproc(pid, ar, 0);
+			exit(1);
+		}
 
-/*
-** read memory area and dump as a number of lines
-*/
-static void
-dumparea(int memfd, long long pid, long long addr, int len)
-{
-	long		i;
-	unsigned char	*buf;
+		ar[0].start  = (void *)address;
+		ar[0].length = length;
+		ar[0].name   = strdup("");
+		nar = 1;
+	}
 
-	// seek to requested address and read bunch of bytes
+	// copy all address ranges in one go and resume target process
 	//
-	if ( (buf = malloc(len)) == 0) {
-		perror("Can't allocate read buffer");
-		detachproc(pid);
-		exit(1);
-       	}
+	if (accmode == ACC_CONSIST) {
+		snapshot(pid, ar, nar);
+		thawproc();
+	}
 
-	if ( lseek(memfd, addr, SEEK_SET) == -1) {
- 		perror("Seek to memory address");
-		detachproc(pid);
-		exit(1);
-       	}
+	// baseline for tracking (raw format) and comparison with it
+	//
+	if (!basepath) {
+		snprintf(bname, sizeof bname, "pad.%lld.base", pid);
+		basepath = bname;
+	}
 
-	if ( (len = read(memfd, buf, len)) == -1) {
-		perror("Read memory address");
-		detachproc(pid);
-		exit(1);
-       	}
+	if (track) {
+		writeraw(basepath, ar, nar);
+		releaseproc(pid, ar, nar);
+		exit(0);
+	}
 
-	// print hex output line-by-line
+	// write binary output formats
 	//
-	for (i=0; i < len; i+=BYTESPERLINE, addr+=BYTESPERLINE) {
-		dumpline(addr, &buf[i],
-			len-i>BYTESPERLINE ? BYTESPERLINE:len-i);
-	}
+	switch (format) {
+	   case FMT_RAW:
+		if (!outpath) {
+			snprintf(fname, sizeof fname, "pad.%lld", pid);
+			outpath = fname;
+			(void) mkdir(outpath, 0755);
+		}
 
-	free(buf);
-}
+		writeraw(outpath, ar, nar);
+		releaseproc(pid, ar, nar);
+		exit(0);
 
+	   case FMT_CORE:
+		if (!outpath) {
+			snprintf(fname, sizeof fname, "core.%lld", pid);
+			outpath = fname;
+		}
 
-/*
-** print one line of hexadecimal and character output
-*/
-static void
-dumpline(long long addr, unsigned char *buf, int len)
-{
-	char	hexpart[BYTESPERLINE*3+1], chars[BYTESPERLINE+1];
-	int	i;
+		writecore(outpath, ar, nar);
+		releaseproc(pid, ar, nar);
+		exit(0);
+	}
 
-	// print address at beginning of line
+	// compare two snapshots of the running target
 	//
-	printf("%012llx  ", addr);
+	if (diff) {
+		livediff(ar, nar, interval);
+		exit(0);
+	}
 
-	// format every byte in hexadecimal and character representation
+	// show written pages that differ from the baseline
 	//
-	for (i=0; i < len; i++) {
-		sprintf(hexpart+i*3, "%02x ", buf[i]);
-
-		if (isprint(buf[i]))
-			chars[i] = buf[i];	// printable
-		else
-			chars[i] = '.';		// non-printable
+	if (delta) {
+		writedelta(basepath, ar, nar);
+		outflush();
+		releaseproc(pid, ar, nar);
+		exit(0);
 	}
 
-	chars[i] = '\0';
-
-	// print hexadecimal and character representation
+	// pointer graph and leak candidates
 	//
-	printf("%-*s  %s\n",  BYTESPERLINE*3, hexpart, chars);
+	if (pointers) {
+		ptrreport(ar, nar);
+		outflush();
+		releaseproc(pid, ar, nar);
+		exit(0);
+	}
+
+	// composition of the malloc heaps
+	//
+	if (heap) {
+		heapreport(ar, nar);
+		outflush();
+		releaseproc(pid, ar, nar);
+		exit(0);
+	}
+
+	// classes of page contents
+	//
+	if (classmode) {
+		classify(ar, nar, classmode == 2);
+		outflush();
+		releaseproc(pid, ar, nar);
+		exit(0);
+	}
+
+	// search, extract strings or dump address ranges one-by-one
+	//
+	showareas(ar, nar);
+
+	if (search)
+		outprintf("%lld matches\n", search->nmatch);
+
+	if (minstr)
+		outprintf("%lld strings\n", nstrings);
+
+	// detach process
+	//
+	releaseproc(pid, ar, nar);
+}
+
+/*
+** search, extract the strings of or dump all address ranges
+*/
+static void
+showareas(struct arange ar[], int nar)
+{
+	int	i;
+
+	for (i=0; i < nar; i++) {
+		if (search) {
+			searcharea(&ar[i]);
+			continue;
+		}
+
+		if (minstr) {
+			stringsarea(&ar[i]);
+			continue;
+		}
+
+		if (dumpall)
+			outprintf("------------  perms=%s  vsize=%lldKiB  %s\n",
+				ar[i].perm, ar[i].length/1024, ar[i].name);
+
+		dumparea(&ar[i]);
+
+		if (dumpall)
+			outprintf("\n");
+	}
+}
+
+
+/*
+** last dumped line, to collapse repeated lines (per thread)
+*/
+__thread long long	lastaddr = -1;		// address after the line
+__thread unsigned char	lastbuf[BYTESPERLINE];
+__thread char		repeating;
+
+/*
+** read memory area and dump as a number of lines
+*/
+static void
+dumparea(struct arange *a)
+{
+	// a run of repeated lines never continues into another area
+	// (or another process); worker threads of the parallel walk
+	// are started per area and begin with a fresh state anyway
+	//
+	lastaddr  = -1;
+	repeating = 0;
+
+	parwalk(a, dumpchunk, dumphole, NULL, !allpages, 1);
+}
+
+/*
+** dump a chunk of readable memory line-by-line
+*/
+static void
+dumpchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	long	i, n;
+
+	for (i=0; i < len; i+=BYTESPERLINE, addr+=BYTESPERLINE) {
+		n = len-i>BYTESPERLINE ? BYTESPERLINE:len-i;
+
+		// a line that repeats the previous line is shown as one
+		// line with '*' (like hexdump); the run is broken at every
+		// piece of a parallel walk, so the output does not depend
+		// on --jobs
+		//
+		if (squeeze) {
+			if (addr == lastaddr && n == BYTESPERLINE &&
+			    (addr - (long long)a->start) % JOBCHUNK &&
+			    memcmp(lastbuf, &buf[i], BYTESPERLINE) == 0) {
+				if (!repeating)
+					outprintf("*\n");
+
+				repeating = 1;
+				lastaddr += BYTESPERLINE;
+				continue;
+			}
+
+			memcpy(lastbuf, &buf[i], n);
+			lastaddr  = addr + n;
+			repeating = 0;
+		}
+
+		dumpline(addr, &buf[i], n);
+
+		if (annotate)
+			annotline(addr, &buf[i], n);
+	}
+}
+
+/*
+** report a range of memory that could not be read, is not resident
+** or only contains zeroes
+*/
+static void
+dumphole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+	outprintf("%012llx  *** %lld bytes %s ***\n", addr, len, pgtext[kind]);
+}
+
+/*
+** range of pages that is not passed as data, collected while walking
+** through an area until a range of another kind follows
+*/
+struct hole {
+	long long	addr, len;
+	int		kind;
+};
+
+/*
+** pass a collected range to the hole function
+*/
+static void
+flushhole(struct arange *a, struct hole *h, holefunc *hf, void *arg)
+{
+	if (h->len)
+		hf(a, h->addr, h->len, h->kind, arg);
+
+	h->len = 0;
+}
+
+/*
+** add a range to the collected range when it is of the same kind
+*/
+static void
+addhole(struct arange *a, struct hole *h, long long addr, long long len,
+				int kind, holefunc *hf, void *arg)
+{
+	if (h->len && (h->kind != kind || h->addr + h->len != addr))
+		flushhole(a, h, hf, arg);
+
+	if (h->len == 0) {
+		h->addr = addr;
+		h->kind = kind;
+	}
+
+	h->len += len;
+}
+
+/*
+** check if a buffer only contains zero bytes
+*/
+static int
+allzero(unsigned char *buf, long len)
+{
+	return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+/*
+** read an area in chunks of at most CHUNKSIZE bytes via the reusable
+** read buffer: every readable chunk is passed to df, every range of
+** unreadable or non-resident pages to hf, as well as every range of
+** complete pages with zeroes when zeroholes is set
+*/
+static void
+walkarea(struct arange *a, datafunc *df, holefunc *hf, void *arg,
+								int zeroholes)
+{
+	walkrange(a, (long long)a->start, (long long)a->start + a->length,
+						df, hf, arg, zeroholes);
+}
+
+/*
+** read the range from addr up to end of an area (see walkarea)
+*/
+static void
+walkrange(struct arange *a, long long addr, long long end, datafunc *df,
+				holefunc *hf, void *arg, int zeroholes)
+{
+	struct hole	h = { 0, 0, 0 };
+	long		want, n, off, next, done;
+	int		kind;
+
+	while (addr < end) {
+		want = end - addr > CHUNKSIZE ? CHUNKSIZE : end - addr;
+
+		// skip pages that are not resident
+		//
+		if ( (kind = pagerun(a, addr, &want)) != PG_READ) {
+			if (kind == PG_SHARED)
+				pfnshown(a, addr, want);	// counted
+
+			addhole(a, &h, addr, want, kind, hf, arg);
+			addr += want;
+			continue;
+		}
+
+		if ( (n = memread(a, addr, chunkbuf, want)) == 0) {
+			// skip unreadable page
+			//
+			n = pagesize - addr % pagesize;
+
+			if (n > end - addr)
+				n = end - addr;
+
+			addhole(a, &h, addr, n, PG_UNREADABLE, hf, arg);
+			addr += n;
+			continue;
+		}
+
+		// pass data, except complete pages that only contain zeroes
+		//
+		for (off = done = 0; zeroholes && off < n; off = next) {
+			next = off + pagesize - (addr + off) % pagesize;
+
+			if (next > n)
+				break;
+
+			if (next - off != pagesize || !allzero(chunkbuf + off, pagesize))
+				continue;
+
+			if (off > done) {
+				flushhole(a, &h, hf, arg);
+				df(a, addr + done, chunkbuf + done, off - done, arg);
+			}
+
+			addhole(a, &h, addr + off, pagesize, PG_ZERO, hf, arg);
+			done = next;
+		}
+
+		if (done < n) {
+			flushhole(a, &h, hf, arg);
+			df(a, addr + done, chunkbuf + done, n - done, arg);
+		}
+
+		pfnshown(a, addr, n);
+		addr += n;
+	}
+
+	flushhole(a, &h, hf, arg);
+}
+
+/*
+** parallel walk through a large area (--jobs): the area is split in
+** pieces of JOBCHUNK bytes that are read by a number of threads
+** for ordered output every piece is formatted in its own slot; the
+** slots are written in address order by the calling thread, which
+** also joins ranges of holes that continue in the next piece
+*/
+struct parslot {
+	long long	item;		// piece in slot (-1: free)
+	int		done;
+	long long	from, to;
+	char		*buf;
+	long		len, size;
+	struct hole	lead, trail;	// holes at start and end of piece
+};
+
+struct parwork {
+	struct arange	*a;
+	datafunc	*df;
+	holefunc	*hf;
+	void		*arg;
+	int		zeroholes, ordered;
+	long long	nitems, next;
+	long long	written;	// pieces written in order
+	struct parslot	*slot;
+	int		nslot;
+	long		slotsize;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+};
+
+__thread struct parslot	*curslot;	// slot of piece being formatted
+
+/*
+** hole in a piece for ordered output: holes at the start or end of
+** the piece are passed to the writer, others are formatted
+*/
+static void
+parhole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+	struct parwork	*pw  = arg;
+	struct parslot	*s   = curslot;
+
+	if (addr == s->from && out.len == 0) {
+		s->lead.addr = addr;
+		s->lead.len  = len;
+		s->lead.kind = kind;
+	} else if (addr + len == s->to) {
+		s->trail.addr = addr;
+		s->trail.len  = len;
+		s->trail.kind = kind;
+	} else {
+		pw->hf(a, addr, len, kind, pw->arg);
+	}
+}
+
+/*
+** thread reading (and formatting) pieces of an area
+*/
+static void *
+parthread(void *arg)
+{
+	struct parwork	*pw = arg;
+	struct parslot	*s = NULL;
+	long long	i, from, to, end = (long long)pw->a->start + pw->a->length;
+
+	if ( (chunkbuf = malloc(CHUNKSIZE)) == NULL ||
+	     (pmbuf = malloc((CHUNKSIZE / pagesize + 2) * sizeof *pmbuf)) == NULL) {
+		perror("Can't allocate read buffer");
+		exit(1);
+	}
+
+	out.fd = -1;		// output only via slots
+
+	pthread_mutex_lock(&pw->lock);
+
+	while (pw->next < pw->nitems) {
+		i    = pw->next++;
+		from = (long long)pw->a->start + i * JOBCHUNK;
+		to   = from + JOBCHUNK > end ? end : from + JOBCHUNK;
+
+		if (pw->ordered) {
+			// wait until the previous piece in the slot has
+			// been written (not a later piece that was
+			// claimed after this one)
+			//
+			s = &pw->slot[i % pw->nslot];
+
+			while (i >= pw->written + pw->nslot)
+				pthread_cond_wait(&pw->cond, &pw->lock);
+
+			s->item = i;
+			s->done = 0;
+			s->from = from;
+			s->to   = to;
+			s->lead.len = s->trail.len = 0;
+		}
+
+		pthread_mutex_unlock(&pw->lock);
+
+		if (pw->ordered) {
+			curslot  = s;
+			out.buf  = s->buf;
+			out.len  = 0;
+			out.size = s->size;
+
+			walkrange(pw->a, from, to, pw->df, parhole, pw,
+							pw->zeroholes);
+		} else {
+			walkrange(pw->a, from, to, pw->df, pw->hf, pw->arg,
+							pw->zeroholes);
+		}
+
+		pthread_mutex_lock(&pw->lock);
+
+		if (pw->ordered) {
+			s->len  = out.len;
+			s->done = 1;
+			pthread_cond_broadcast(&pw->cond);
+		}
+	}
+
+	pthread_mutex_unlock(&pw->lock);
+
+	free(chunkbuf);
+	free(pmbuf);
+
+	return NULL;
+}
+
+/*
+** walk through an area with njobs threads (see walkarea); with
+** ordered set the data and hole functions format output that is
+** written in address order
+*/
+static void
+parwalk(struct arange *a, datafunc *df, holefunc *hf, void *arg,
+					int zeroholes, int ordered)
+{
+	struct parwork	pw;
+	struct parslot	*s;
+	struct hole	h = { 0, 0, 0 };
+	pthread_t	*tids;
+	long long	i;
+	int		t, nthr;
+
+	if (njobs <= 1 || a->length <= JOBCHUNK) {
+		walkarea(a, df, hf, arg, zeroholes);
+		return;
+	}
+
+	memset(&pw, 0, sizeof pw);
+	pw.a         = a;
+	pw.df        = df;
+	pw.hf        = hf;
+	pw.arg       = arg;
+	pw.zeroholes = zeroholes;
+	pw.ordered   = ordered;
+	pw.nitems    = (a->length + JOBCHUNK - 1) / JOBCHUNK;
+
+	nthr = pw.nitems < njobs ? pw.nitems : njobs;
+
+	pthread_mutex_init(&pw.lock, NULL);
+	pthread_cond_init(&pw.cond, NULL);
+
+	if (ordered) {
+		// every line of a piece, plus hole lines between pages
+		//
+		pw.nslot    = nthr * 2;
+		pw.slotsize = (JOBCHUNK / BYTESPERLINE +
+			       2 * JOBCHUNK / pagesize + 4) * MAXLINE;
+
+		if ( (pw.slot = calloc(pw.nslot, sizeof *pw.slot)) == NULL) {
+			perror("Can't allocate output slots");
+			exit(1);
+		}
+
+		for (t=0; t < pw.nslot; t++) {
+			pw.slot[t].item = -1;
+
+			if ( (pw.slot[t].buf = malloc(pw.slotsize)) == NULL) {
+				perror("Can't allocate output slots");
+				exit(1);
+			}
+
+			pw.slot[t].size = pw.slotsize;
+		}
+	}
+
+	if ( (tids = malloc(nthr * sizeof *tids)) == NULL) {
+		perror("Can't allocate threads");
+		exit(1);
+	}
+
+	for (t=0; t < nthr; t++) {
+		if (pthread_create(&tids[t], NULL, parthread, &pw) != 0) {
+			perror("Create thread");
+			exit(1);
+		}
+	}
+
+	// write formatted pieces in address order, joining holes
+	// that continue from one piece into the next
+	//
+	for (i=0; ordered && i < pw.nitems; i++) {
+		s = &pw.slot[i % pw.nslot];
+
+		pthread_mutex_lock(&pw.lock);
+
+		while (s->item != i || !s->done)
+			pthread_cond_wait(&pw.cond, &pw.lock);
+
+		pthread_mutex_unlock(&pw.lock);
+
+		if (s->lead.len)
+			addhole(a, &h, s->lead.addr, s->lead.len, s->lead.kind,
+								hf, arg);
+
+		if (s->len) {
+			flushhole(a, &h, hf, arg);
+
+			if (out.len + s->len > out.size)
+				outflush();
+
+			if (s->len > out.size) {	// slot was enlarged
+				outwrite(s->buf, s->len);
+			} else {
+				memcpy(out.buf + out.len, s->buf, s->len);
+				out.len += s->len;
+			}
+		}
+
+		if (s->trail.len)
+			addhole(a, &h, s->trail.addr, s->trail.len,
+						s->trail.kind, hf, arg);
+
+		pthread_mutex_lock(&pw.lock);
+		s->item    = -1;
+		pw.written = i + 1;
+		pthread_cond_broadcast(&pw.cond);
+		pthread_mutex_unlock(&pw.lock);
+	}
+
+	flushhole(a, &h, hf, arg);
+
+	for (t=0; t < nthr; t++)
+		pthread_join(tids[t], NULL);
+
+	for (t=0; t < pw.nslot; t++)
+		free(pw.slot[t].buf);
+
+	free(pw.slot);
+	free(tids);
+	pthread_mutex_destroy(&pw.lock);
+	pthread_cond_destroy(&pw.cond);
+}
+
+/*
+** convert a pagemap entry into a page state
+*/
+static int
+pagekind(unsigned long long pme)
+{
+	if (delta && !(pme & PM_SOFTDIRTY))
+		return PG_CLEAN;
+
+	if (allpages || pme & PM_PRESENT)
+		return PG_READ;
+
+	if (pme & PM_SWAP)
+		return swapin ? PG_READ : PG_SWAPPED;
+
+	return PG_ABSENT;
+}
+
+/*
+** determine the state of the page at addr and shorten len to the
+** range of following pages with the same state
+** returns the state (PG_READ when unknown)
+*/
+static int
+pagerun(struct arange *a, long long addr, long *len)
+{
+	long long	first = addr / pagesize;
+	long		npg = (addr + *len - 1) / pagesize - first + 1, i;
+	unsigned char	*ps;
+	int		kind;
+
+	if (allpages && !delta)
+		return PG_READ;
+
+	if (a->pstate) {
+		// page states saved while taking the snapshot
+		//
+		ps   = a->pstate + first - (long long)a->start / pagesize;
+		kind = ps[0];
+
+		for (i=1; i < npg && ps[i] == kind; i++)
+			;
+	} else {
+		pmpages = 0;
+
+		if (pmfd == -1 || pread(pmfd, pmbuf, npg * sizeof *pmbuf,
+				first * sizeof *pmbuf) != npg * sizeof *pmbuf)
+			return PG_READ;
+
+		pmfirst = first;
+		pmpages = npg;
+
+		kind = pfnkind(pmbuf[0], 0);
+
+		for (i=1; i < npg && pfnkind(pmbuf[i], 0) == kind; i++)
+			;
+	}
+
+	if (i < npg)
+		*len = (first + i) * pagesize - addr;
+
+	return kind;
+}
+
+/*
+** clear the soft-dirty bits of all pages of the target
+*/
+static int
+clearrefs(long pid)
+{
+	char	path[128];
+	int	fd;
+
+	snprintf(path, sizeof path, "/proc/%ld/clear_refs", pid);
+
+	if ( (fd = open(path, O_WRONLY)) == -1 || write(fd, "4", 1) != 1) {
+		perror("Clear soft-dirty bits");
+
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/*
+** save the state of all pages of an area (consistent mode: the page
+** states are determined while the target is stopped)
+*/
+static void
+pagestates(struct arange *a)
+{
+	long long	first = (long long)a->start / pagesize,
+			last  = ((long long)a->start + a->length - 1) / pagesize,
+			pg;
+	long		npg, i;
+
+	if ((allpages && !delta) || pmfd == -1)
+		return;
+
+	if ( (a->pstate = malloc(last - first + 1)) == NULL ||
+	     (procs && (a->pme = malloc((last - first + 1) *
+						sizeof *a->pme)) == NULL)) {
+		perror("Can't allocate page states");
+		thawproc();
+		exit(1);
+	}
+
+	for (pg = first; pg <= last; pg += npg) {
+		npg = last - pg + 1 > CHUNKSIZE / pagesize ?
+				CHUNKSIZE / pagesize : last - pg + 1;
+
+		if (pread(pmfd, pmbuf, npg * sizeof *pmbuf, pg * sizeof *pmbuf)
+						!= npg * sizeof *pmbuf) {
+			free(a->pstate);	// state unknown: read all
+			free(a->pme);
+			a->pstate = NULL;
+			a->pme    = NULL;
+			return;
+		}
+
+		for (i=0; i < npg; i++)
+			a->pstate[pg - first + i] = pfnkind(pmbuf[i], 0);
+
+		if (a->pme)
+			memcpy(a->pme + pg - first, pmbuf, npg * sizeof *pmbuf);
+	}
+}
+
+/*
+** read memory of target process at addr, dependent on access mode
+** returns the number of bytes that could be read contiguously from
+** addr: less than len when an unreadable page is reached and 0 when
+** the page of addr itself can not be read
+*/
+static long
+memread(struct arange *a, long long addr, unsigned char *buf, long len)
+{
+	long	n;
+
+	switch (accmode) {
+	   case ACC_LIVE:
+		return vmread(pid, addr, buf, len);
+
+	   case ACC_CONSIST:
+		return snapread(a, addr, buf, len);
+
+	   default:
+		// read bunch of bytes at requested address; only lseek
+		// accepts addresses beyond 2^63 for /proc/pid/mem
+		//
+		if (addr >= 0) {
+			if ( (n = pread(memfd, buf, len, addr)) == -1)
+				return 0;
+
+			return n;
+		}
+
+		if ( lseek(memfd, addr, SEEK_SET) == -1)
+			return 0;
+
+		if ( (n = read(memfd, buf, len)) == -1)
+			return 0;
+
+		return n;
+	}
+}
+
+
+/*
+** format one line of hexadecimal and character output into the
+** output buffer (identical to "%012llx  " followed by "%02x " for
+** every byte padded to BYTESPERLINE*3 positions, two spaces and the
+** characters)
+*/
+static void
+dumpline(long long addr, unsigned char *buf, int len)
+{
+	char			*p, *h, *c;
+	unsigned long long	a = addr;
+	int			i, ndig;
+
+	outroom(MAXLINE);
+
+	p = out.buf + out.len;
+
+	// address at beginning of line (at least 12 hex digits)
+	//
+	for (ndig=12; ndig < 16 && (a >> ndig*4); ndig++)
+		;
+
+	for (i=ndig-1; i >= 0; i--, a >>= 4)
+		p[i] = "0123456789abcdef"[a & 0xf];
+
+	p += ndig;
+	*p++ = ' ';
+	*p++ = ' ';
+
+	// hexadecimal and character representation of every byte
+	//
+	h = p;
+	c = p + BYTESPERLINE*3 + 2;
+
+	for (i=0; i < len; i++) {
+		h[0] = hexpair[buf[i]][0];
+		h[1] = hexpair[buf[i]][1];
+		h[2] = ' ';
+		h += 3;
+
+		*c++ = printable[buf[i]];
+	}
+
+	// pad hexadecimal part of short line
+	//
+	memset(h, ' ', (BYTESPERLINE - len) * 3 + 2);
+
+	*c++ = '\n';
+
+	out.len = c - out.buf;
+}
+
+/*
+** compressed output (--compress): an LZ4 frame (to be read with
+** lz4 -d or lz4cat) of independent blocks, compressed like the fast
+** mode of LZ4 with one hashed candidate per position, fewer probes in
+** data without matches, and stored as is when they do not shrink
+*/
+#define	LZ4_FLG		0x60		// version 1, independent blocks
+#define	LZ4_BD		0x70		// maximum block size 4 MiB
+#define	LZ4_HC		0x73		// second byte of xxh32(FLG, BD)
+#define	LZ4_HASHLOG	16
+#define	LZ4_MINMATCH	4
+#define	LZ4_MFLIMIT	12		// no match starts in the last 12 bytes
+#define	LZ4_LASTLIT	5		// the last 5 bytes are literals
+#define	LZ4_MAXOFF	65535
+#define	LZ4_BOUND(n)	((n) + (n)/255 + 16)
+
+unsigned char	*lz4buf;		// compressed block
+unsigned int	lz4tab[1 << LZ4_HASHLOG];	// last position per hash
+char		lz4started;		// frame header written
+
+/*
+** add the extension bytes of a literal or match length to a sequence
+*/
+static unsigned char *
+lz4len(unsigned char *op, long n)
+{
+	for (; n >= 0; n -= 255)
+		*op++ = n < 255 ? n : 255;
+
+	return op;
+}
+
+/*
+** add a sequence of literals followed by a match (none when mlen is 0)
+*/
+static unsigned char *
+lz4seq(unsigned char *op, unsigned char *lit, long nlit, long off, long mlen)
+{
+	unsigned char	*token = op++;
+
+	*token = (nlit < 15 ? nlit : 15) << 4;
+	op     = lz4len(op, nlit - 15);
+
+	memcpy(op, lit, nlit);
+	op += nlit;
+
+	if (mlen) {
+		*op++   = off & 0xff;
+		*op++   = off >> 8;
+		*token |= mlen - LZ4_MINMATCH < 15 ? mlen - LZ4_MINMATCH : 15;
+		op      = lz4len(op, mlen - LZ4_MINMATCH - 15);
+	}
+
+	return op;
+}
+
+/*
+** compress one block (at most LZ4_BOUND(len) bytes)
+*/
+static long
+lz4block(unsigned char *src, long len, unsigned char *dst)
+{
+	unsigned char	*ip = src, *anchor = src, *ref, *op = dst;
+	unsigned char	*mflimit = src + (len > LZ4_MFLIMIT ? len - LZ4_MFLIMIT : 0);
+	unsigned char	*matchlimit = src + len - LZ4_LASTLIT;
+	unsigned int	seq, cand, h;
+	long		mlen, misses = 0;
+
+	memset(lz4tab, 0, sizeof lz4tab);
+
+	while (ip < mflimit) {
+		memcpy(&seq, ip, sizeof seq);
+		h   = seq * 2654435761U >> (32 - LZ4_HASHLOG);
+		ref = src + lz4tab[h];
+		lz4tab[h] = ip - src;
+
+		memcpy(&cand, ref, sizeof cand);
+
+		if (ref >= ip || ip - ref > LZ4_MAXOFF || cand != seq) {
+			ip += 1 + (misses++ >> 6);	// skip faster
+			continue;
+		}
+
+		misses = 0;
+
+		// extend the match backwards into the literals and forwards
+		//
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (mlen=LZ4_MINMATCH; ip + mlen < matchlimit &&
+					ip[mlen] == ref[mlen]; mlen++)
+			;
+
+		op     = lz4seq(op, anchor, ip - anchor, ip - ref, mlen);
+		ip    += mlen;
+		anchor = ip;
+	}
+
+	op = lz4seq(op, anchor, src + len - anchor, 0, 0);
+
+	return op - dst;
+}
+
+/*
+** write one block of the frame (preceded by the frame header)
+*/
+static void
+lz4write(unsigned char *buf, long len)
+{
+	unsigned char	hdr[7] = { 0x04, 0x22, 0x4d, 0x18,
+				   LZ4_FLG, LZ4_BD, LZ4_HC };
+	unsigned long	n;
+
+	if (!lz4started) {
+		fdwrite((char *)hdr, sizeof hdr);
+		lz4started = 1;
+	}
+
+	if (len == 0)
+		return;
+
+	n = lz4block(buf, len, lz4buf + 4);
+
+	if (n >= len) {				// stored uncompressed
+		n = len | 0x80000000UL;
+		memcpy(lz4buf + 4, buf, len);
+	}
+
+	lz4buf[0] = n;
+	lz4buf[1] = n >> 8;
+	lz4buf[2] = n >> 16;
+	lz4buf[3] = n >> 24;
+
+	fdwrite((char *)lz4buf, 4 + (n & 0x7fffffff));
+}
+
+/*
+** terminate the frame with an empty block
+*/
+static void
+lz4end(void)
+{
+	lz4write(NULL, 0);
+	fdwrite("\0\0\0\0", 4);
+}
+
+/*
+** prepare output buffer and formatting tables
+*/
+static void
+outinit(void)
+{
+	int	i;
+
+	if ( (out.buf = malloc(out.size)) == NULL) {
+		perror("Can't allocate output buffer");
+		exit(1);
+	}
+
+	for (i=0; i < 256; i++) {
+		hexpair[i][0] = "0123456789abcdef"[i >> 4];
+		hexpair[i][1] = "0123456789abcdef"[i & 0xf];
+		printable[i]  = isprint(i) ? i : '.';
+	}
+
+	if (compress) {
+		if ( (lz4buf = malloc(LZ4_BOUND(OUTBUFSIZE))) == NULL) {
+			perror("Can't allocate compression buffer");
+			exit(1);
+		}
+
+		atexit(lz4end);		// called after the last flush
+	}
+
+	atexit(outflush);
+}
+
+/*
+** write the contents of the output buffer to standard output
+*/
+static void
+outflush(void)
+{
+	outwrite(out.buf, out.len);
+	out.len = 0;
+}
+
+/*
+** make room for len more bytes in the output buffer: flush it, or
+** enlarge the slot when formatting a piece in a thread of --jobs
+** (such a thread has no output file)
+*/
+static void
+outroom(long len)
+{
+	struct parslot	*s = curslot;
+
+	if (out.len + len <= out.size)
+		return;
+
+	if (out.fd != -1) {
+		outflush();
+		return;
+	}
+
+	while (out.len + len > s->size)
+		s->size *= 2;
+
+	if ( (s->buf = realloc(s->buf, s->size)) == NULL) {
+		perror("Can't enlarge output slot");
+		exit(1);
+	}
+
+	out.buf  = s->buf;
+	out.size = s->size;
+}
+
+/*
+** write a formatted buffer to the output file (compressed in blocks
+** of at most OUTBUFSIZE bytes with --compress)
+*/
+static void
+outwrite(char *buf, long len)
+{
+	long	n;
+
+	if (!compress) {
+		fdwrite(buf, len);
+		return;
+	}
+
+	for (; len > 0; buf += n, len -= n) {
+		n = len > OUTBUFSIZE ? OUTBUFSIZE : len;
+		lz4write((unsigned char *)buf, n);
+	}
+}
+
+/*
+** write a buffer completely to the output file
+*/
+static void
+fdwrite(char *buf, long len)
+{
+	long	done = 0, n;
+
+	while (done < len) {
+		if ( (n = write(out.fd, buf + done, len - done)) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			perror("Write output");
+			_exit(1);
+		}
+
+		done += n;
+	}
+}
+
+/*
+** formatted print into the output buffer
+*/
+static void
+outprintf(const char *fmt, ...)
+{
+	va_list	ap;
+	int	n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(out.buf + out.len, out.size - out.len, fmt, ap);
+	va_end(ap);
+
+	if (n >= out.size - out.len) {	// did not fit
+		outroom(n + 1);
+
+		va_start(ap, fmt);
+		n = vsnprintf(out.buf + out.len, out.size - out.len, fmt, ap);
+		va_end(ap);
+
+		if (n >= out.size - out.len)
+			n = out.size - out.len - 1;
+	}
+
+	out.len += n;
+}
+
+/*
+** detach target process from current process (in consistent mode:
+** resume its threads when they are still stopped)
+*/
+static void
+detachproc(int pid)
+{
+	if (accmode == ACC_CONSIST)
+		thawproc();
+
+	if (accmode != ACC_PTRACE)
+		return;
+
+	// detaching requires the target to be stopped (as it is since
+	// the attach) and resumes it
+	//
+        (void) ptrace(PTRACE_DETACH, pid, NULL, NULL);
+}
+
+/*
+** prepare access to the memory of the target process, dependent on
+** the access mode, and open its pagemap when needed
+** returns -1 when the process can not be accessed
+*/
+static int
+attachproc(long pid)
+{
+	char	fname[128];
+
+	switch (accmode) {
+	   case ACC_PTRACE:
+		// attach target process: required to be able to read memory
+		//
+        	if (ptrace(PTRACE_ATTACH, pid, NULL, NULL) == -1) {
+        	    perror("Attach to specified pid");
+        	    return -1;
+        	}
+
+        	(void) waitpid(pid, NULL, __WALL);
+
+		tasks[0].tid = pid;
+		getregs(&tasks[0]);
+		ntasks = 1;
+
+		// open memory of target process
+		//
+        	snprintf(fname, sizeof fname, "/proc/%ld/mem", pid);
+
+        	if ( (memfd = open(fname, O_RDONLY)) == -1) {
+        		perror("Open memory of process");
+			detachproc(pid);
+			return -1;
+        	}
+		break;
+
+	   case ACC_CONSIST:
+		// stop all threads of target process
+		//
+		if (freezeproc(pid) == -1) {
+			thawproc();
+			return -1;
+		}
+		break;
+	}
+
+	// page states are only needed to skip non-resident pages
+	// (without privileges the state bits are still available)
+	//
+	if (!allpages || delta) {
+        	snprintf(fname, sizeof fname, "/proc/%ld/pagemap", pid);
+
+		if ( (pmfd = open(fname, O_RDONLY)) == -1 && delta) {
+			perror("Open pagemap of process");
+			detachproc(pid);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+** release all resources used to access the memory of a target process
+** and detach from it
+*/
+static void
+releaseproc(long pid, struct arange ar[], int nar)
+{
+	int	i;
+
+	if (memfd != -1)
+		(void) close(memfd);
+
+	if (snapfd != -1)
+		(void) close(snapfd);
+
+	if (pmfd != -1)
+		(void) close(pmfd);
+
+	memfd = snapfd = pmfd = -1;
+
+	for (i=0; i < nar; i++) {
+		free(ar[i].snapok);
+		free(ar[i].pstate);
+		free(ar[i].pme);
+		ar[i].snapok = NULL;
+		ar[i].pstate = NULL;
+		ar[i].pme    = NULL;
+	}
+
+	detachproc(pid);
+	ntasks = 0;
+}
+
+/*
+** read memory of target process via process_vm_readv without
+** stopping it; the remote area is split into page-sized iovecs
+** (at most IOV_MAX per call) to be able to determine at which
+** page a partial read stopped
+** returns the number of bytes read contiguously from the start
+*/
+static long
+vmread(long pid, long long addr, unsigned char *buf, long len)
+{
+	struct iovec	local, remote[IOV_MAX];
+	long		done = 0, want, n;
+	long long	a;
+	int		niov;
+
+	while (done < len) {
+		// prepare batch of remote iovecs
+		//
+		for (niov=0, want=0, a=addr+done;
+		     niov < IOV_MAX && done+want < len; niov++) {
+			remote[niov].iov_base = (void *)a;
+			remote[niov].iov_len  = pagesize - a % pagesize;
+
+			if (remote[niov].iov_len > len - done - want)
+				remote[niov].iov_len = len - done - want;
+
+			want += remote[niov].iov_len;
+			a    += remote[niov].iov_len;
+		}
+
+		local.iov_base = buf + done;
+		local.iov_len  = want;
+
+		n = process_vm_readv(pid, &local, 1, remote, niov, 0);
+
+		if (n == -1)
+			break;
+
+		done += n;
+
+		if (n < want)		// stopped at unreadable page
+			break;
+	}
+
+	return done;
+}
+
+/*
+** stop all threads of the target process with PTRACE_SEIZE and
+** PTRACE_INTERRUPT; the list of threads is scanned repeatedly
+** until no new threads appear
+*/
+static int
+freezeproc(long pid)
+{
+	char		path[128];
+	DIR		*dirp;
+	struct dirent	*dent;
+	pid_t		tid;
+	int		i, status, found;
+
+	snprintf(path, sizeof path, "/proc/%ld/task", pid);
+
+	frozen = 1;
+
+	do {
+		if ( (dirp = opendir(path)) == NULL) {
+			perror("Open task directory");
+			return -1;
+		}
+
+		found = 0;
+
+		while ( (dent = readdir(dirp)) ) {
+			if ( (tid = atoi(dent->d_name)) == 0)
+				continue;
+
+			for (i=0; i < ntasks; i++)
+				if (tasks[i].tid == tid)
+					break;
+
+			if (i < ntasks)
+				continue;	// already stopped
+
+			if (ntasks == MAXTASK) {
+				fprintf(stderr, "too many threads\n");
+				closedir(dirp);
+				return -1;
+			}
+
+			if (ptrace(PTRACE_SEIZE, tid, NULL, NULL) == -1) {
+				if (errno == ESRCH)
+					continue;	// thread just exited
+
+				perror("Seize thread of specified pid");
+				closedir(dirp);
+				return -1;
+			}
+
+			tasks[ntasks].tid = tid;
+			tasks[ntasks].sig = 0;
+			ntasks++;
+			found++;
+
+			if (ptrace(PTRACE_INTERRUPT, tid, NULL, NULL) == -1 ||
+			    waitpid(tid, &status, __WALL) == -1)
+				continue;
+
+			getregs(&tasks[ntasks-1]);
+
+			// stopped for signal delivery: pass on when resuming
+			//
+			if (WIFSTOPPED(status) && (status >> 16) == 0 &&
+			    WSTOPSIG(status) != SIGTRAP)
+				tasks[ntasks-1].sig = WSTOPSIG(status);
+		}
+
+		closedir(dirp);
+	} while (found);
+
+	return 0;
+}
+
+/*
+** resume all threads stopped by freezeproc (only once)
+*/
+static void
+thawproc(void)
+{
+	int	i;
+
+	if (!frozen)
+		return;
+
+	for (i=0; i < ntasks; i++)
+		(void) ptrace(PTRACE_DETACH, tasks[i].tid, NULL,
+						(void *)(long)tasks[i].sig);
+
+	frozen = 0;
+}
+
+/*
+** get the general registers of a stopped thread
+*/
+static void
+getregs(struct task *t)
+{
+	struct iovec	iov;
+
+	iov.iov_base = &t->regs;
+	iov.iov_len  = sizeof t->regs;
+
+	t->hasregs = ptrace(PTRACE_GETREGSET, t->tid,
+				(void *)NT_PRSTATUS, &iov) != -1;
+}
+
+/*
+** copy the contents of all address ranges to the snapshot file while
+** the target is stopped; for every page a bit is set in the bitmap
+** of the area when the page could be copied
+*/
+static void
+snapshot(long pid, struct arange ar[], int nar)
+{
+	char		path[PATH_MAX], *dir = getenv("TMPDIR");
+	long long	addr, end, off = 0, pg, first;
+	long		want, n;
+	int		i;
+
+	snprintf(path, sizeof path, "%s/padXXXXXX", dir ? dir : "/var/tmp");
+
+	if ( (snapfd = mkstemp(path)) == -1) {
+		perror("Create snapshot file");
+		thawproc();
+		exit(1);
+	}
+
+	(void) unlink(path);		// destroy when closed
+
+	for (i=0; i < nar; i++) {
+		addr  = (long long)ar[i].start;
+		end   = addr + ar[i].length;
+		first = addr / pagesize;
+
+		ar[i].snapoff = off;
+		ar[i].snapok  = calloc(((end - 1) / pagesize - first) / 8 + 1, 1);
+
+		if (!ar[i].snapok) {
+			perror("Can't allocate snapshot bitmap");
+			thawproc();
+			exit(1);
+		}
+
+		pagestates(&ar[i]);
+
+		while (addr < end) {
+			want = end - addr > CHUNKSIZE ? CHUNKSIZE : end - addr;
+
+			// only copy the pages that will be dumped
+			//
+			if (pagerun(&ar[i], addr, &want) != PG_READ) {
+				addr += want;
+				continue;
+			}
+
+			if ( (n = vmread(pid, addr, chunkbuf, want)) == 0) {
+				addr += pagesize - addr % pagesize;
+				continue;
+			}
+
+			if (pwrite(snapfd, chunkbuf, n, ar[i].snapoff +
+				   addr - (long long)ar[i].start) != n) {
+				perror("Write snapshot file");
+				thawproc();
+				exit(1);
+			}
+
+			for (pg = addr / pagesize; pg <= (addr + n - 1) / pagesize;
+									pg++)
+				ar[i].snapok[(pg-first)/8] |= 1 << (pg-first)%8;
+
+			addr += n;
+		}
+
+		off += ar[i].length;
+	}
+}
+
+/*
+** read from the snapshot file the copy of memory at addr
+** returns the number of bytes read contiguously from addr
+*/
+static long
+snapread(struct arange *a, long long addr, unsigned char *buf, long len)
+{
+	long long	first = (long long)a->start / pagesize, pg;
+	long		avail;
+
+	for (pg = addr / pagesize; pg * pagesize < addr + len; pg++)
+		if ( !(a->snapok[(pg-first)/8] & (1 << (pg-first)%8)) )
+			break;
+
+	if (pg == addr / pagesize)
+		return 0;
+
+	avail = pg * pagesize - addr;
+
+	if (avail > len)
+		avail = len;
+
+	if ( (avail = pread(snapfd, buf, avail, a->snapoff + addr -
+					(long long)a->start)) == -1)
+		return 0;
+
+	return avail;
+}
+
+
+/*
+** convert a search pattern: a string, or hex bytes after "x:" with
+** '?' for an insignificant nibble, optionally followed by "/" and
+** hex mask bytes
+** returns NULL for an invalid pattern
+*/
+static struct pattern *
+parsepattern(char *str)
+{
+	struct pattern	*pt;
+	char		*p, *m;
+	int		i, n, run;
+
+	if ( (pt = calloc(1, sizeof *pt)) == NULL) {
+		perror("Can't allocate pattern");
+		exit(1);
+	}
+
+	if (strncmp(str, "x:", 2) != 0) {
+		// plain string
+		//
+		if ( (pt->len = strlen(str)) > MAXPAT || pt->len == 0)
+			return NULL;
+
+		memcpy(pt->byte, str, pt->len);
+		memset(pt->mask, 0xff, pt->len);
+	} else {
+		// hex bytes (spaces allowed between bytes)
+		//
+		for (p = str+2, n = 0; *p && *p != '/'; p++) {
+			if (isspace(*p))
+				continue;
+
+			if (n/2 >= MAXPAT)
+				return NULL;
+
+			if (*p == '?') {
+				i = 0;
+			} else if (isxdigit(*p)) {
+				i = isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10;
+				pt->mask[n/2] |= n%2 ? 0x0f : 0xf0;
+			} else {
+				return NULL;
+			}
+
+			pt->byte[n/2] |= n%2 ? i : i << 4;
+			n++;
+		}
+
+		if (n == 0 || n%2)
+			return NULL;
+
+		pt->len = n/2;
+
+		// optional mask bytes
+		//
+		if (*p == '/') {
+			for (m = p+1, n = 0; *m; m++) {
+				if (isspace(*m))
+					continue;
+
+				if (!isxdigit(*m) || n/2 >= pt->len)
+					return NULL;
+
+				i = isdigit(*m) ? *m - '0' : tolower(*m) - 'a' + 10;
+
+				if (n%2 == 0)
+					pt->mask[n/2] &= (i << 4) | 0x0f;
+				else
+					pt->mask[n/2] &= i | 0xf0;
+				n++;
+			}
+
+			if (n != pt->len*2)
+				return NULL;
+		}
+
+		for (i=0; i < pt->len; i++)
+			pt->byte[i] &= pt->mask[i];
+	}
+
+	// determine longest run of fully significant bytes
+	//
+	for (i=0, run=0; i < pt->len; i++) {
+		run = pt->mask[i] == 0xff ? run + 1 : 0;
+
+		if (run > pt->anchorlen) {
+			pt->anchorlen = run;
+			pt->anchor    = i - run + 1;
+		}
+	}
+
+	return pt;
+}
+
+/*
+** compare the pattern with the bytes at p
+*/
+static int
+patmatch(struct pattern *pt, unsigned char *p)
+{
+	int	i;
+
+	for (i=0; i < pt->len; i++)
+		if ((p[i] & pt->mask[i]) != pt->byte[i])
+			return 0;
+
+	return 1;
+}
+
+/*
+** report a match with one line of context before and after
+*/
+static void
+showmatch(struct arange *a, long long addr)
+{
+	unsigned char	ctx[MAXPAT + 3*BYTESPERLINE];
+	long long	from, to, start = (long long)a->start;
+	long		i, n;
+
+	search->nmatch++;
+
+	from = addr - addr % BYTESPERLINE - BYTESPERLINE;
+	to   = addr + search->len + BYTESPERLINE;
+	to  += (BYTESPERLINE - to % BYTESPERLINE) % BYTESPERLINE;
+
+	if (from < start)
+		from = start;
+
+	if (to > start + a->length)
+		to = start + a->length;
+
+	outprintf("match at %012llx  %s+%llx\n", addr,
+			a->name[0] ? a->name : "[anon]", addr - start);
+
+	n = memread(a, from, ctx, to - from);
+
+	for (i=0; i < n; i+=BYTESPERLINE)
+		dumpline(from + i, &ctx[i],
+			n-i > BYTESPERLINE ? BYTESPERLINE : n-i);
+
+	outprintf("\n");
+}
+
+/*
+** find all matches that start in buf[0] up to buf[lim-1] while buf
+** contains len bytes
+*/
+static void
+scanbuf(struct arange *a, long long addr, unsigned char *buf, long len,
+								long lim)
+{
+	struct pattern	*pt = search;
+	unsigned char	*p, *q, *end = buf + len - pt->len + 1;
+
+	if (lim > len - pt->len + 1)
+		lim = len - pt->len + 1;
+
+	if (lim <= 0)
+		return;
+
+	if (pt->anchorlen == 0) {
+		// no fully significant byte: compare everywhere
+		//
+		for (p = buf; p < buf + lim; p++)
+			if (patmatch(pt, p))
+				showmatch(a, addr + (p - buf));
+		return;
+	}
+
+	// locate the anchor with memmem and verify the remainder
+	//
+	for (q = buf + pt->anchor; q < end + pt->anchor; q++) {
+		q = memmem(q, end + pt->anchor + pt->anchorlen - 1 - q,
+				pt->byte + pt->anchor, pt->anchorlen);
+
+		if (q == NULL)
+			break;
+
+		p = q - pt->anchor;
+
+		if (p - buf >= lim)
+			break;
+
+		if (pt->anchorlen == pt->len || patmatch(pt, p))
+			showmatch(a, addr + (p - buf));
+	}
+}
+
+/*
+** search a chunk of readable memory, including matches that start
+** in the previous chunk and end in this one
+*/
+static void
+searchchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct pattern	*pt = search;
+	long		n;
+
+	// join end of previous chunk with start of this chunk
+	//
+	if (pt->taillen && pt->tailaddr + pt->taillen == addr) {
+		n = len < pt->len - 1 ? len : pt->len - 1;
+		memcpy(pt->tail + pt->taillen, buf, n);
+
+		scanbuf(a, pt->tailaddr, pt->tail, pt->taillen + n, pt->taillen);
+	}
+
+	scanbuf(a, addr, buf, len, len);
+
+	// keep last bytes for next chunk
+	//
+	n = len < pt->len - 1 ? len : pt->len - 1;
+	memcpy(pt->tail, buf + len - n, n);
+	pt->tailaddr = addr + len - n;
+	pt->taillen  = n;
+}
+
+/*
+** search an area for the pattern
+*/
+static void
+searcharea(struct arange *a)
+{
+	search->taillen = 0;
+	walkarea(a, searchchunk, skiphole, NULL, 0);
+}
+
+
+/*
+** string extraction (--strings): runs of at least minstr printable
+** characters (ASCII, and UTF-16LE at even addresses); a run that
+** reaches the end of a chunk is kept until the next chunk shows
+** where it ends
+*/
+struct strrun {
+	long long	start, end;	// address range of the run so far
+	char		*buf;		// characters of the run
+	long		len, size;
+};
+
+struct strrun	strrun[2];		// ASCII and UTF-16 runs
+char		strchar[256];		// printable characters (and tab)
+char		strwide[CHUNKSIZE/2];	// characters of a UTF-16 run
+
+#define	ONES		0x0101010101010101ULL
+#define	HIGHS		0x8080808080808080ULL
+#define	HASLESS(x, n)	(((x) - ONES * (n)) & ~(x) & HIGHS)
+#define	HASMORE(x, n)	((((x) + ONES * (127 - (n))) | (x)) & HIGHS)
+#define	EVENS		0x00ff00ff00ff00ffULL	// bytes at even addresses
+
+/*
+** show a string with its address and the name of its area
+*/
+static void
+showstring(struct arange *a, long long addr, int kind, char *s, long len)
+{
+	char	*name = strrchr(a->name, '/') ? strrchr(a->name, '/') + 1 :
+			a->name[0] ? a->name : "[anon]";
+
+	outprintf("%012llx  %c  %s  ", addr, kind, name);
+
+	outroom(len + 1);
+
+	if (len + 1 > out.size) {		// very long string
+		outwrite(s, len);
+	} else {
+		memcpy(out.buf + out.len, s, len);
+		out.len += len;
+	}
+
+	outprintf("\n");
+	nstrings++;
+}
+
+/*
+** add characters to a run that continues in the next chunk
+*/
+static void
+addrun(struct strrun *r, long long start, long long end, char *s, long len)
+{
+	if (r->len == 0)
+		r->start = start;
+
+	if (r->len + len > r->size) {
+		r->size = (r->len + len) * 2;
+
+		if ( (r->buf = realloc(r->buf, r->size)) == NULL) {
+			perror("Can't allocate string");
+			detachproc(pid);
+			exit(1);
+		}
+	}
+
+	memcpy(r->buf + r->len, s, len);
+	r->len += len;
+	r->end  = end;
+}
+
+/*
+** end of a kept run: show it when it is long enough
+*/
+static void
+endrun(struct arange *a, struct strrun *r, int kind)
+{
+	if (r->len >= minstr)
+		showstring(a, r->start, kind, r->buf, r->len);
+
+	r->len = 0;
+}
+
+/*
+** find the runs of printable ASCII characters in a chunk; runs are
+** skipped 8 bytes at a time as long as all bytes of a word are
+** in the range 0x20-0x7e, and words with zeroes are skipped at once
+*/
+static void
+asciichunk(struct arange *a, long long addr, unsigned char *buf, long len)
+{
+	struct strrun		*r = &strrun[0];
+	unsigned long long	w;
+	long			i, j;
+
+	if (r->len && r->end != addr)		// hole in between
+		endrun(a, r, 'a');
+
+	for (i=0; i < len; i = j) {
+		if (!strchar[buf[i]]) {
+			if (r->len)
+				endrun(a, r, 'a');
+
+			j = i + 1;
+
+			while (j % 8 && j < len && !strchar[buf[j]])
+				j++;
+
+			for (; j + 8 <= len; j += 8) {
+				memcpy(&w, buf + j, 8);
+
+				if (w)
+					break;
+			}
+			continue;
+		}
+
+		for (j=i; j + 8 <= len; j += 8) {
+			memcpy(&w, buf + j, 8);
+
+			if (HASLESS(w, 0x20) || HASMORE(w, 0x7e))
+				break;
+		}
+
+		while (j < len && strchar[buf[j]])
+			j++;
+
+		if (j == len || r->len) {	// continues or continued
+			addrun(r, addr + i, addr + j, (char *)buf + i, j - i);
+
+			if (j < len)
+				endrun(a, r, 'a');
+		} else if (j - i >= minstr) {
+			showstring(a, addr + i, 'a', (char *)buf + i, j - i);
+		}
+	}
+}
+
+/*
+** find the runs of UTF-16LE characters (printable ASCII followed by
+** a zero byte) at even addresses in a chunk; words of 8 bytes are
+** skipped at once when no odd byte is zero (or all bytes are zero),
+** and taken at once as four characters when all odd bytes are zero
+** and all even bytes are in the range 0x20-0x7e
+*/
+static void
+widechunk(struct arange *a, long long addr, unsigned char *buf, long len)
+{
+	struct strrun		*r = &strrun[1];
+	unsigned long long	w;
+	long			i, j, k, n;
+
+	if (r->len && r->end != addr + (addr & 1))
+		endrun(a, r, 'u');
+
+	for (i = addr & 1; i + 2 <= len; i = j) {
+		if (buf[i+1] != 0 || !strchar[buf[i]]) {
+			if (r->len)
+				endrun(a, r, 'u');
+
+			for (j = i + 2; j + 8 <= len; j += 8) {
+				memcpy(&w, buf + j, 8);
+
+				if (w && HASLESS(w | EVENS, 1))
+					break;
+			}
+			continue;
+		}
+
+		for (j=i; j + 8 <= len; j += 8) {
+			memcpy(&w, buf + j, 8);
+
+			if (w & ~EVENS)
+				break;
+
+			w |= ~EVENS & ONES * 'a';	// odd bytes printable
+
+			if (HASLESS(w, 0x20) || HASMORE(w, 0x7e))
+				break;
+		}
+
+		while (j + 2 <= len && buf[j+1] == 0 && strchar[buf[j]])
+			j += 2;
+
+		for (k=i, n=0; k < j; k += 2)
+			strwide[n++] = buf[k];
+
+		if (j + 2 > len || r->len) {	// continues or continued
+			addrun(r, addr + i, addr + j, strwide, n);
+
+			if (j + 2 <= len)
+				endrun(a, r, 'u');
+		} else if (n >= minstr) {
+			showstring(a, addr + i, 'u', strwide, n);
+		}
+	}
+}
+
+static void
+strchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	asciichunk(a, addr, buf, len);
+	widechunk(a, addr, buf, len);
+}
+
+/*
+** show the strings of an area
+*/
+static void
+stringsarea(struct arange *a)
+{
+	int	c;
+
+	for (c=0; c < 256; c++)
+		strchar[c] = (c >= 0x20 && c < 0x7f) || c == '\t';
+
+	walkarea(a, strchunk, skiphole, NULL, 1);
+
+	endrun(a, &strrun[0], 'a');
+	endrun(a, &strrun[1], 'u');
+}
+
+/*
+** binary output: file descriptor and file offset of the start of
+** the current area, and the hashes of the pages of the current area
+*/
+struct fileout {
+	int			fd;
+	long long		off;
+	unsigned long long	*hash;
+};
+
+/*
+** page hashes: 64-bit hash in the style of xxHash (four independent
+** lanes of multiply-rotate rounds that the compiler can vectorize)
+** a hash value of zero means "unknown"
+*/
+#define	HPRIME1		0x9E3779B185EBCA87ULL
+#define	HPRIME2		0xC2B2AE3D27D4EB4FULL
+#define	HPRIME3		0x165667B19E3779F9ULL
+#define	HPRIME4		0x85EBCA77C2B2AE63ULL
+#define	HPRIME5		0x27D4EB2F165667C5ULL
+
+#define	ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long
+pagehash(unsigned char *buf, long len)
+{
+	unsigned long long	v[4] = { HPRIME1 + HPRIME2, HPRIME2, 0, -HPRIME1 },
+				h, k;
+	long			i;
+	int			l;
+
+	for (i=0; i + 32 <= len; i += 32) {
+		for (l=0; l < 4; l++) {
+			memcpy(&k, buf + i + l*8, 8);
+			v[l] = ROTL(v[l] + k * HPRIME2, 31) * HPRIME1;
+		}
+	}
+
+	h = ROTL(v[0], 1) + ROTL(v[1], 7) + ROTL(v[2], 12) + ROTL(v[3], 18);
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&k, buf + i, 8);
+		h ^= ROTL(k * HPRIME2, 31) * HPRIME1;
+		h  = ROTL(h, 27) * HPRIME1 + HPRIME4;
+	}
+
+	for (; i < len; i++) {
+		h ^= buf[i] * HPRIME5;
+		h  = ROTL(h, 11) * HPRIME1;
+	}
+
+	h += len;
+	h ^= h >> 33;
+	h *= HPRIME2;
+	h ^= h >> 29;
+	h *= HPRIME3;
+	h ^= h >> 32;
+
+	return h ? h : 1;
+}
+
+/*
+** write a chunk of readable memory to its position in the output file
+** and hash the pages that are completely contained in the chunk
+*/
+static void
+filechunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct fileout	*fo = arg;
+	long long	first = (long long)a->start / pagesize, pg, from, to;
+	long		done = 0, n;
+
+	while (done < len) {
+		n = pwrite(fo->fd, buf + done, len - done,
+			   fo->off + addr - (long long)a->start + done);
+
+		if (n == -1) {
+			perror("Write output file");
+			detachproc(pid);
+			exit(1);
+		}
+
+		done += n;
+	}
+
+	for (pg = addr / pagesize; fo->hash && pg * pagesize < addr + len; pg++) {
+		from = pg * pagesize;
+		to   = from + pagesize;
+
+		if (from < (long long)a->start)
+			from = (long long)a->start;
+
+		if (to > (long long)a->start + a->length)
+			to = (long long)a->start + a->length;
+
+		if (from >= addr && to <= addr + len)
+			fo->hash[pg - first] = pagehash(buf + from - addr, to - from);
+		else
+			fo->hash[pg - first] = 0;	// partly in this chunk
+	}
+}
+
+/*
+** unreadable memory remains a hole in binary output
+*/
+static void
+skiphole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+}
+
+/*
+** number of (partial) pages of an area
+*/
+static long
+areapages(long long start, long long end)
+{
+	return (end - 1) / pagesize - start / pagesize + 1;
+}
+
+/*
+** write the contents of every area in raw binary format, either as
+** one file per area in a directory or concatenated in one file,
+** together with an index of the areas and the hashes of all pages
+*/
+static void
+writeraw(char *path, struct arange ar[], int nar)
+{
+	char		fname[PATH_MAX], *base;
+	struct stat	st;
+	struct fileout	fo;
+	FILE		*idx, *hfp;
+	long		npg, pg;
+	int		i, isdir;
+
+	isdir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+
+	if (isdir) {
+		snprintf(fname, sizeof fname, "%s/index", path);
+	} else {
+		snprintf(fname, sizeof fname, "%s.index", path);
+
+		if ( (fo.fd = open(path, O_WRONLY|O_CREAT|O_TRUNC,
+							0644)) == -1) {
+			perror(path);
+			detachproc(pid);
+			exit(1);
+		}
+	}
+
+	if ( (idx = fopen(fname, "w")) == NULL) {
+		perror(fname);
+		detachproc(pid);
+		exit(1);
+	}
+
+	snprintf(fname, sizeof fname, isdir ? "%s/hash" : "%s.hash", path);
+
+	if ( (hfp = fopen(fname, "w")) == NULL) {
+		perror(fname);
+		detachproc(pid);
+		exit(1);
+	}
+
+	base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	fo.off = 0;
+
+	for (i=0; i < nar; i++) {
+		if (isdir) {
+			snprintf(fname, sizeof fname, "%s/%012llx-%012llx.bin",
+				path, (long long)ar[i].start,
+				(long long)ar[i].start + ar[i].length);
+
+			if ( (fo.fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC,
+							0644)) == -1) {
+				perror(fname);
+				detachproc(pid);
+				exit(1);
+			}
+
+			fo.off = 0;
+		}
+
+		// pages that are not written contain zeroes (only
+		// complete pages, partial pages at the edges are unknown)
+		//
+		npg = areapages((long long)ar[i].start,
+				(long long)ar[i].start + ar[i].length);
+
+		if ( (fo.hash = malloc(npg * sizeof *fo.hash)) == NULL) {
+			perror("Can't allocate page hashes");
+			detachproc(pid);
+			exit(1);
+		}
+
+		for (pg=0; pg < npg; pg++)
+			fo.hash[pg] = zerohash;
+
+		if ((long long)ar[i].start % pagesize)
+			fo.hash[0] = 0;
+
+		if (((long long)ar[i].start + ar[i].length) % pagesize)
+			fo.hash[npg-1] = 0;
+
+		parwalk(&ar[i], filechunk, skiphole, &fo, 1, 0);
+
+		// extend to full length in case of trailing hole
+		//
+		if (ftruncate(fo.fd, fo.off + ar[i].length) == -1) {
+			perror("Extend output file");
+			detachproc(pid);
+			exit(1);
+		}
+
+		fprintf(idx, "%012llx-%012llx %s %s %lld %s\n",
+			(long long)ar[i].start,
+			(long long)ar[i].start + ar[i].length, ar[i].perm,
+			isdir ? strrchr(fname, '/') + 1 : base, fo.off,
+			ar[i].name);
+
+		fwrite(fo.hash, sizeof *fo.hash, npg, hfp);
+		free(fo.hash);
+
+		if (isdir)
+			close(fo.fd);
+		else
+			fo.off += ar[i].length;
+	}
+
+	if (!isdir)
+		close(fo.fd);
+
+	if (fclose(idx) == EOF || fclose(hfp) == EOF) {
+		perror("Write index");
+		detachproc(pid);
+		exit(1);
+	}
+}
+
+/*
+** raw snapshot as written by writeraw: the areas listed in its index,
+** the data files and (optionally) the page hashes
+*/
+struct snaparea {
+	long long		start, end, off;
+	char			perm[16];
+	char			name[128];
+	char			*file;
+	unsigned long long	*hash;		// NULL: unknown
+};
+
+struct snap {
+	char			dir[PATH_MAX];	// directory of data files
+	struct snaparea		*sa;
+	int			nsa, last;
+	int			fd;		// data file opened last
+	char			*fdfile;
+	unsigned long long	*hash;
+};
+
+/*
+** load the index and the page hashes of a raw snapshot
+** returns -1 when the snapshot can not be loaded
+*/
+static int
+loadsnap(char *path, struct snap *sn)
+{
+	char		line[PATH_MAX + 256], file[PATH_MAX], *p;
+	struct stat	st;
+	FILE		*idx;
+	long long	npg = 0;
+	int		fd, n, max = 0;
+
+	memset(sn, 0, sizeof *sn);
+	sn->fd = -1;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+		snprintf(sn->dir, sizeof sn->dir, "%s", path);
+		snprintf(line, sizeof line, "%s/index", path);
+	} else {
+		snprintf(sn->dir, sizeof sn->dir, "%s", path);
+
+		if ( (p = strrchr(sn->dir, '/')) )
+			*p = '\0';
+		else
+			strcpy(sn->dir, ".");
+
+		snprintf(line, sizeof line, "%s.index", path);
+	}
+
+	if ( (idx = fopen(line, "r")) == NULL) {
+		perror(line);
+		return -1;
+	}
+
+	// index lines: start-end perms file offset name
+	//
+	while (fgets(line, sizeof line, idx)) {
+		if (sn->nsa == max) {
+			max = max ? max * 2 : 256;
+
+			if ( (sn->sa = realloc(sn->sa, max * sizeof *sn->sa)) == NULL) {
+				perror("Can't allocate snapshot index");
+				exit(1);
+			}
+		}
+
+		memset(&sn->sa[sn->nsa], 0, sizeof *sn->sa);
+
+		if (sscanf(line, "%llx-%llx %15s %4095s %lld %n",
+			   &sn->sa[sn->nsa].start, &sn->sa[sn->nsa].end,
+			   sn->sa[sn->nsa].perm, file,
+			   &sn->sa[sn->nsa].off, &n) < 5)
+			continue;
+
+		line[strcspn(line, "\n")] = '\0';
+		snprintf(sn->sa[sn->nsa].name, sizeof sn->sa[sn->nsa].name,
+							"%s", line + n);
+
+		sn->sa[sn->nsa].file = strdup(file);
+		npg += areapages(sn->sa[sn->nsa].start, sn->sa[sn->nsa].end);
+		sn->nsa++;
+	}
+
+	fclose(idx);
+
+	// page hashes of all areas in the order of the index
+	//
+	if (S_ISDIR(st.st_mode))
+		snprintf(line, sizeof line, "%s/hash", path);
+	else
+		snprintf(line, sizeof line, "%s.hash", path);
+
+	if ( (fd = open(line, O_RDONLY)) != -1) {
+		if ( (sn->hash = malloc(npg * sizeof *sn->hash)) &&
+		     read(fd, sn->hash, npg * sizeof *sn->hash) ==
+						npg * sizeof *sn->hash) {
+			for (n=0, npg=0; n < sn->nsa; n++) {
+				sn->sa[n].hash = sn->hash + npg;
+				npg += areapages(sn->sa[n].start, sn->sa[n].end);
+			}
+		}
+
+		close(fd);
+	}
+
+	return 0;
+}
+
+/*
+** release a loaded snapshot
+*/
+static void
+freesnap(struct snap *sn)
+{
+	int	i;
+
+	for (i=0; i < sn->nsa; i++)
+		free(sn->sa[i].file);
+
+	if (sn->fd != -1)
+		close(sn->fd);
+
+	free(sn->sa);
+	free(sn->hash);
+}
+
+/*
+** find the area of a snapshot containing addr
+*/
+static struct snaparea *
+findsnap(struct snap *sn, long long addr)
+{
+	int	i;
+
+	if (sn->last < sn->nsa && sn->sa[sn->last].start <= addr &&
+						addr < sn->sa[sn->last].end)
+		return &sn->sa[sn->last];
+
+	for (i=0; i < sn->nsa; i++) {
+		if (sn->sa[i].start <= addr && addr < sn->sa[i].end) {
+			sn->last = i;
+			return &sn->sa[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+** read the contents of addr from a snapshot area (missing bytes
+** are zero)
+*/
+static void
+snapdata(struct snap *sn, struct snaparea *s, long long addr,
+						unsigned char *buf, long len)
+{
+	char	path[PATH_MAX + 64];
+	long	n = 0;
+
+	if (sn->fdfile != s->file) {
+		if (sn->fd != -1)
+			close(sn->fd);
+
+		snprintf(path, sizeof path, "%s/%s", sn->dir, s->file);
+		sn->fd     = open(path, O_RDONLY);
+		sn->fdfile = s->file;
+	}
+
+	if (sn->fd != -1 && (n = pread(sn->fd, buf, len,
+					s->off + addr - s->start)) == -1)
+		n = 0;
+
+	memset(buf + n, 0, len - n);
+}
+
+/*
+** state while comparing the written pages of an area with the baseline
+*/
+struct deltastate {
+	struct snap	base;
+	int		shown;		// area header shown
+	unsigned char	*old;		// page from baseline
+	long long	npages, nchanged, nbytes;
+};
+
+/*
+** compare a chunk of written pages with the baseline and show the
+** lines that differ
+*/
+static void
+deltachunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct deltastate	*ds = arg;
+	struct snaparea		*b;
+	long			off, next, i, n, nl;
+	int			changed;
+
+	for (off = 0; off < len; off = next) {
+		next = off + pagesize - (addr + off) % pagesize;
+
+		if (next > len)
+			next = len;
+
+		ds->npages++;
+
+		// page of baseline (missing: zero bytes)
+		//
+		memset(ds->old, 0, pagesize);
+
+		if ( (b = findsnap(&ds->base, addr + off)) ) {
+			n = next - off;
+
+			if (n > b->end - (addr + off))
+				n = b->end - (addr + off);
+
+			snapdata(&ds->base, b, addr + off, ds->old, n);
+		}
+
+		for (i = off, changed = 0; i < next; i += BYTESPERLINE) {
+			nl = next - i > BYTESPERLINE ? BYTESPERLINE : next - i;
+
+			if (memcmp(ds->old + i - off, buf + i, nl) == 0)
+				continue;
+
+			if (!ds->shown) {
+				outprintf("------------  perms=%s  vsize=%lldKiB  %s\n",
+					a->perm, a->length/1024, a->name);
+				ds->shown = 1;
+			}
+
+			for (n=0; n < nl; n++)
+				if (ds->old[i - off + n] != buf[i + n])
+					ds->nbytes++;
+
+			outprintf("- ");
+			dumpline(addr + i, ds->old + i - off, nl);
+			outprintf("+ ");
+			dumpline(addr + i, buf + i, nl);
+			changed = 1;
+		}
+
+		ds->nchanged += changed;
+	}
+}
+
+/*
+** show the written pages that differ from the baseline
+*/
+static void
+writedelta(char *path, struct arange ar[], int nar)
+{
+	struct deltastate	ds;
+	int			i;
+
+	memset(&ds, 0, sizeof ds);
+
+	if (loadsnap(path, &ds.base) == -1) {
+		detachproc(pid);
+		exit(1);
+	}
+
+	if ( (ds.old = malloc(pagesize)) == NULL) {
+		perror("Can't allocate page buffer");
+		detachproc(pid);
+		exit(1);
+	}
+
+	for (i=0; i < nar; i++) {
+		ds.shown = 0;
+		walkarea(&ar[i], deltachunk, skiphole, &ds, 0);
+
+		if (ds.shown)
+			outprintf("\n");
+	}
+
+	outprintf("%lld pages written, %lld pages changed, %lld bytes changed\n",
+			ds.npages, ds.nchanged, ds.nbytes);
+
+	freesnap(&ds.base);
+	free(ds.old);
+}
+
+/*
+** range of changed bytes while comparing two snapshots: differences
+** that are less than MERGEGAP bytes apart are reported as one range
+*/
+#define	MERGEGAP	8
+
+struct diffrange {
+	long long	start, end;	// end == 0: no range yet
+	long long	nbytes;
+};
+
+static void
+flushrange(struct diffrange *r)
+{
+	if (r->end)
+		outprintf("%012llx-%012llx  %lld bytes changed\n",
+				r->start, r->end, r->nbytes);
+
+	r->end    = 0;
+	r->nbytes = 0;
+}
+
+/*
+** compare the pages of two snapshots and report per area of the second
+** snapshot the ranges of bytes that changed; pages with equal hashes
+** are not read
+*/
+static void
+diffsnaps(char *patha, char *pathb)
+{
+	struct snap		sna, snb;
+	struct snaparea		*a, *b;
+	struct diffrange	r;
+	unsigned char		*pa, *pb;
+	unsigned long long	ha, hb;
+	long long		addr, next, pgb, npages = 0, nchanged = 0,
+				nbytes = 0, apages, abytes;
+	long			i, n;
+	int			j, changed;
+
+	if (loadsnap(patha, &sna) == -1 || loadsnap(pathb, &snb) == -1)
+		exit(1);
+
+	if ( (pa = malloc(pagesize)) == NULL || (pb = malloc(pagesize)) == NULL) {
+		perror("Can't allocate page buffers");
+		exit(1);
+	}
+
+	for (j=0; j < snb.nsa; j++) {
+		b = &snb.sa[j];
+
+		outprintf("------------  perms=%s  vsize=%lldKiB  %s\n",
+				b->perm, (b->end - b->start)/1024, b->name);
+
+		// area that did not exist in the first snapshot
+		//
+		for (i=0; i < sna.nsa; i++)
+			if (sna.sa[i].start < b->end && b->start < sna.sa[i].end)
+				break;
+
+		if (i == sna.nsa) {
+			outprintf("    new area\n\n");
+			continue;
+		}
+
+		memset(&r, 0, sizeof r);
+		apages = abytes = 0;
+
+		for (addr = b->start; addr < b->end; addr = next) {
+			next = (addr / pagesize + 1) * pagesize;
+
+			if (next > b->end)
+				next = b->end;
+
+			a = findsnap(&sna, addr);
+
+			if (a && next > a->end)
+				next = a->end;
+
+			n   = next - addr;
+			pgb = addr / pagesize - b->start / pagesize;
+			npages++;
+
+			// equal hashes: page not changed
+			//
+			hb = b->hash ? b->hash[pgb] : 0;
+
+			if (a)
+				ha = a->hash ? a->hash[addr / pagesize -
+						a->start / pagesize] : 0;
+			else
+				ha = zerohash;
+
+			if (ha && hb && ha == hb)
+				continue;
+
+			snapdata(&snb, b, addr, pb, n);
+
+			if (a)
+				snapdata(&sna, a, addr, pa, n);
+			else
+				memset(pa, 0, n);
+
+			for (i=0, changed=0; i < n; i++) {
+				if (pa[i] == pb[i])
+					continue;
+
+				if (r.end && addr + i - r.end >= MERGEGAP)
+					flushrange(&r);
+
+				if (!r.end)
+					r.start = addr + i;
+
+				r.end = addr + i + 1;
+				r.nbytes++;
+				abytes++;
+				changed = 1;
+			}
+
+			apages += changed;
+		}
+
+		flushrange(&r);
+
+		if (apages)
+			outprintf("    %lld pages changed, %lld bytes changed\n",
+							apages, abytes);
+
+		outprintf("\n");
+
+		nchanged += apages;
+		nbytes   += abytes;
+	}
+
+	// areas that disappeared
+	//
+	for (j=0; j < sna.nsa; j++) {
+		for (i=0; i < snb.nsa; i++)
+			if (snb.sa[i].start < sna.sa[j].end &&
+			    sna.sa[j].start < snb.sa[i].end)
+				break;
+
+		if (i == snb.nsa)
+			outprintf("------------  removed area %012llx-%012llx  %s\n\n",
+				sna.sa[j].start, sna.sa[j].end, sna.sa[j].name);
+	}
+
+	outprintf("%lld pages compared, %lld pages changed, %lld bytes changed\n",
+				npages, nchanged, nbytes);
+
+	freesnap(&sna);
+	freesnap(&snb);
+	free(pa);
+	free(pb);
+}
+
+/*
+** remove the files of a raw snapshot written to one file
+*/
+static void
+removesnap(char *path)
+{
+	char	fname[PATH_MAX];
+
+	(void) unlink(path);
+	snprintf(fname, sizeof fname, "%s.index", path);
+	(void) unlink(fname);
+	snprintf(fname, sizeof fname, "%s.hash", path);
+	(void) unlink(fname);
+}
+
+/*
+** take a snapshot of a running target, wait and take another snapshot,
+** and compare both
+*/
+static void
+livediff(struct arange ar[], int nar, double interval)
+{
+	char		dir[PATH_MAX], patha[PATH_MAX+2], pathb[PATH_MAX+2],
+			*tmp = getenv("TMPDIR");
+	struct timespec	ts;
+
+	snprintf(dir, sizeof dir, "%s/padXXXXXX", tmp ? tmp : "/var/tmp");
+
+	if (mkdtemp(dir) == NULL) {
+		perror("Create snapshot directory");
+		exit(1);
+	}
+
+	snprintf(patha, sizeof patha, "%s/a", dir);
+	snprintf(pathb, sizeof pathb, "%s/b", dir);
+
+	writeraw(patha, ar, nar);
+
+	ts.tv_sec  = interval;
+	ts.tv_nsec = (interval - ts.tv_sec) * 1000000000;
+
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+
+	// areas might have been added or removed meanwhile
+	//
+	if (dumpall && (nar = getaddranges(pid, &ar, &maxar)) == -1) {
+		removesnap(patha);
+		rmdir(dir);
+		exit(1);
+	}
+
+	writeraw(pathb, ar, nar);
+	diffsnaps(patha, pathb);
+
+	removesnap(patha);
+	removesnap(pathb);
+	rmdir(dir);
+}
+
+/*
+** watch a range of the running target (--watch): the range is read
+** with process_vm_readv every interval without stopping the target,
+** and every line that changed since the previous sample is shown as
+** a pair of '-' (previous) and '+' (current) lines after a line with
+** the time of the sample; with --summary only the number of changes
+** per line is shown when watching ends (interrupt, or the range can
+** not be read anymore)
+*/
+volatile sig_atomic_t	watchstop;
+
+static void
+watchsig(int sig)
+{
+	watchstop = 1;
+}
+
+/*
+** format the current time as hh:mm:ss.uuuuuu
+*/
+static char *
+timestamp(char *buf, int size)
+{
+	struct timespec	ts;
+	struct tm	tm;
+	int		n;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	localtime_r(&ts.tv_sec, &tm);
+
+	n = strftime(buf, size, "%H:%M:%S", &tm);
+	snprintf(buf + n, size - n, ".%06ld", ts.tv_nsec / 1000);
+
+	return buf;
+}
+
+static void
+watchrange(long long addr, long long len)
+{
+	unsigned char		*old, *cur;
+	long long		i, nl, nlines, nsamples = 0, nchanged = 0;
+	long long		nlchanged = 0, *count = NULL;
+	char			(*last)[16] = NULL, ts[32];
+	struct timespec		next, start, end;
+	struct sigaction	sa;
+	int			changed;
+	double			secs;
+
+	nlines = (len + BYTESPERLINE - 1) / BYTESPERLINE;
+
+	if ( (old = malloc(len)) == NULL || (cur = malloc(len)) == NULL ||
+	     (showsum && ((count = calloc(nlines, sizeof *count)) == NULL ||
+			  (last  = calloc(nlines, sizeof *last))  == NULL))) {
+		perror("Can't allocate watch buffers");
+		exit(1);
+	}
+
+	if (vmread(pid, addr, old, len) != len) {
+		perror("Read watched range");
+		exit(1);
+	}
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = watchsig;
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	// initial contents
+	//
+	if (!showsum) {
+		outprintf("------------  time=%s  initial\n",
+					timestamp(ts, sizeof ts));
+
+		for (i=0; i < len; i += BYTESPERLINE)
+			dumpline(addr + i, old + i,
+				len - i > BYTESPERLINE ? BYTESPERLINE : len - i);
+
+		outflush();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+
+	while (!watchstop) {
+		// next sample at a fixed rate (missed samples are skipped)
+		//
+		next.tv_sec  += (long)interval;
+		next.tv_nsec += (interval - (long)interval) * 1000000000;
+
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (end.tv_sec > next.tv_sec ||
+		    (end.tv_sec == next.tv_sec && end.tv_nsec > next.tv_nsec))
+			next = end;
+		else if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+							&next, NULL) != 0)
+			continue;		// interrupted
+
+		if (vmread(pid, addr, cur, len) != len) {
+			if (kill(pid, 0) == -1 && errno == ESRCH)
+				fprintf(stderr, "process %lld terminated\n", pid);
+			else
+				fprintf(stderr, "watched range not readable\n");
+			break;
+		}
+
+		nsamples++;
+
+		for (i=0, changed=0; i < len; i += BYTESPERLINE) {
+			nl = len - i > BYTESPERLINE ? BYTESPERLINE : len - i;
+
+			if (memcmp(old + i, cur + i, nl) == 0)
+				continue;
+
+			if (!changed && !showsum)
+				outprintf("------------  time=%s  sample=%lld\n",
+					timestamp(ts, sizeof ts), nsamples);
+
+			changed = 1;
+			nlchanged++;
+
+			if (showsum) {
+				count[i / BYTESPERLINE]++;
+				timestamp(last[i / BYTESPERLINE], sizeof *last);
+				continue;
+			}
+
+			outprintf("- ");
+			dumpline(addr + i, old + i, nl);
+			outprintf("+ ");
+			dumpline(addr + i, cur + i, nl);
+		}
+
+		if (!changed)
+			continue;
+
+		nchanged++;
+		memcpy(old, cur, len);
+
+		if (!showsum)
+			outflush();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	// changes per line
+	//
+	if (showsum) {
+		outprintf("ADDRESS         CHANGES  LAST CHANGE\n");
+
+		for (i=0; i < nlines; i++)
+			if (count[i])
+				outprintf("%012llx %10lld  %s\n",
+					addr + i * BYTESPERLINE, count[i], last[i]);
+	}
+
+	outprintf("%lld samples in %.3f seconds (%.1f/s), %lld with changes, "
+		  "%lld changed lines\n", nsamples, secs,
+		  secs > 0 ? nsamples / secs : 0.0, nchanged, nlchanged);
+
+	free(old);
+	free(cur);
+	free(count);
+	free(last);
+}
+
+/*
+** duplicate page analysis: per area the number of resident pages, of
+** pages with zeroes, of pages of which the contents also occur in
+** another page (duplicate) and of the pages that could be saved
+** by sharing one copy of every group of duplicates
+*/
+struct dedupvma {
+	long		pid;
+	long long	start, length;
+	char		perm[16];
+	char		name[128];
+	long long	resident, zero, dup, save;
+};
+
+struct deduppage {
+	unsigned long long	hash;
+	int			vma;
+};
+
+struct dedup {
+	struct dedupvma		*vma;
+	int			nvma, maxvma;
+	struct deduppage	*page;
+	long long		npage, maxpage;
+};
+
+/*
+** register the hash of every complete page of a chunk
+*/
+static void
+dedupchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct dedup	*dd = arg;
+	long		off;
+
+	for (off = (pagesize - addr % pagesize) % pagesize;
+				off + pagesize <= len; off += pagesize) {
+		if (dd->npage == dd->maxpage) {
+			dd->maxpage = dd->maxpage ? dd->maxpage * 2 : 65536;
+
+			if ( (dd->page = realloc(dd->page,
+				dd->maxpage * sizeof *dd->page)) == NULL) {
+				perror("Can't allocate page hashes");
+				detachproc(pid);
+				exit(1);
+			}
+		}
+
+		dd->page[dd->npage].hash  = pagehash(buf + off, pagesize);
+		dd->page[dd->npage].vma   = dd->nvma - 1;
+		dd->npage++;
+
+		dd->vma[dd->nvma - 1].resident++;
+	}
+}
+
+/*
+** count the pages with zeroes (not hashed: all identical)
+*/
+static void
+deduphole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+	struct dedup	*dd = arg;
+
+	if (kind == PG_ZERO) {
+		dd->vma[dd->nvma - 1].zero     += len / pagesize;
+		dd->vma[dd->nvma - 1].resident += len / pagesize;
+	}
+}
+
+/*
+** order page hashes by hash value, and within a group of duplicates
+** by area to attribute the first copy to the first area
+*/
+static int
+dedupcmp(const void *a, const void *b)
+{
+	const struct deduppage	*pa = a, *pb = b;
+
+	if (pa->hash != pb->hash)
+		return pa->hash < pb->hash ? -1 : 1;
+
+	return pa->vma - pb->vma;
+}
+
+/*
+** check if an area contains private anonymous memory (KSM candidate)
+*/
+static int
+privanon(struct dedupvma *v)
+{
+	return v->perm[3] == 'p' && v->name[0] != '/';
+}
+
+/*
+** hash the resident pages of all given processes and report duplicates
+*/
+static void
+dedupreport(int npid, char *pids[])
+{
+	struct dedup	dd;
+	struct dedupvma	*v, *names = NULL, *nm;
+	long long	i, j, ngroup = 0;
+	long long	tres = 0, tzero = 0, tdup = 0, tsave = 0, tksm = 0;
+	int		p, n, nar, nnames = 0;
+	char		*e;
+	long		kib = pagesize / 1024;
+
+	memset(&dd, 0, sizeof dd);
+
+	for (p=0; p < npid; p++) {
+		pid = strtol(pids[p], &e, 10);
+
+		if (*e) {
+			fprintf(stderr, "invalid pid value %s\n", pids[p]);
+			exit(1);
+		}
+
+		if (attachproc(pid) == -1)
+			exit(1);
+
+		if ( (nar = getaddranges(pid, &ar, &maxar)) == -1) {
+			releaseproc(pid, ar, 0);
+			exit(1);
+		}
+
+		if (accmode == ACC_CONSIST) {
+			snapshot(pid, ar, nar);
+			thawproc();
+		}
+
+		for (n=0; n < nar; n++) {
+			if (dd.nvma == dd.maxvma) {
+				dd.maxvma = dd.maxvma ? dd.maxvma * 2 : 1024;
+
+				if ( (dd.vma = realloc(dd.vma,
+					dd.maxvma * sizeof *dd.vma)) == NULL) {
+					perror("Can't allocate areas");
+					releaseproc(pid, ar, nar);
+					exit(1);
+				}
+			}
+
+			v = &dd.vma[dd.nvma++];
+			memset(v, 0, sizeof *v);
+			v->pid    = pid;
+			v->start  = (long long)ar[n].start;
+			v->length = ar[n].length;
+			strcpy(v->perm, ar[n].perm);
+			snprintf(v->name, sizeof v->name, "%s",
+					ar[n].name[0] ? ar[n].name : "[anon]");
+
+			walkarea(&ar[n], dedupchunk, deduphole, &dd, 1);
+		}
+
+		releaseproc(pid, ar, nar);
+	}
+
+	// group identical pages: every copy after the first can be saved
+	//
+	qsort(dd.page, dd.npage, sizeof *dd.page, dedupcmp);
+
+	for (i=0; i < dd.npage; i = j) {
+		for (j=i+1; j < dd.npage && dd.page[j].hash == dd.page[i].hash; j++)
+			dd.vma[dd.page[j].vma].save++;
+
+		if (j - i > 1) {
+			for (; i < j; i++)
+				dd.vma[dd.page[i].vma].dup++;
+			ngroup++;
+		}
+	}
+
+	// per area
+	//
+	outprintf("    PID  ADDRESS        RESIDENT      ZERO  DUPLICATE    SAVING"
+	          "  NAME   (KiB)\n");
+
+	for (n=0; n < dd.nvma; n++) {
+		v = &dd.vma[n];
+
+		if (v->resident == 0)
+			continue;
+
+		outprintf("%7ld  %012llx %9lld %9lld  %9lld %9lld  %s\n",
+			v->pid, v->start, v->resident * kib, v->zero * kib,
+			v->dup * kib, (v->save + v->zero) * kib, v->name);
+
+		tres  += v->resident;
+		tzero += v->zero;
+		tdup  += v->dup;
+		tsave += v->save + v->zero;
+
+		if (privanon(v))
+			tksm += v->save + v->zero;
+
+		// accumulate per mapping name
+		//
+		for (i=0; i < nnames && strcmp(names[i].name, v->name); i++)
+			;
+
+		if (i == nnames) {
+			if ( (names = realloc(names, ++nnames * sizeof *names)) == NULL) {
+				perror("Can't allocate names");
+				exit(1);
+			}
+
+			memset(&names[i], 0, sizeof *names);
+			strcpy(names[i].name, v->name);
+		}
+
+		nm = &names[i];
+		nm->resident += v->resident;
+		nm->zero     += v->zero;
+		nm->dup      += v->dup;
+		nm->save     += v->save + v->zero;
+	}
+
+	// per mapping name
+	//
+	outprintf("\n                       RESIDENT      ZERO  DUPLICATE    SAVING"
+	          "  NAME   (KiB)\n");
+
+	for (i=0; i < nnames; i++)
+		outprintf("                      %9lld %9lld  %9lld %9lld  %s\n",
+			names[i].resident * kib, names[i].zero * kib,
+			names[i].dup * kib, names[i].save * kib, names[i].name);
+
+	outprintf("\nresident %lld KiB, zero pages %lld KiB, "
+		  "duplicates %lld KiB in %lld groups\n",
+		  tres * kib, tzero * kib, tdup * kib, ngroup);
+
+	outprintf("potential saving %lld KiB (%.1f%%), "
+		  "of which %lld KiB private anonymous (KSM)\n",
+		  tsave * kib, tres ? tsave * 100.0 / tres : 0.0, tksm * kib);
+
+	free(names);
+	free(dd.vma);
+	free(dd.page);
+}
+
+
+/*
+** several processes (pid,pid,... or --tree): the physical pages (PFN
+** from pagemap, only visible with CAP_SYS_ADMIN) of all processes are
+** registered, and a resident page of which the physical page has been
+** registered before is shown as a range of shared pages instead of
+** its contents; per process the resident pages and the pages shared
+** with another process are counted
+*/
+struct pfnent {
+	unsigned long long	pfn;		// 0: free entry
+	int			owner;		// process that showed it
+	int			count;		// mappings by the owner, or
+						// -1 when mapped by others
+};
+
+struct pfnent	*pfntab;
+long		pfnsize, npfn;
+pthread_mutex_t	pfnlock = PTHREAD_MUTEX_INITIALIZER;
+
+struct proc {
+	long		pid;
+	char		comm[32];
+	long long	resident, shared;
+	int		done;
+};
+
+int		curproc;			// index in procs
+
+/*
+** find the entry of a physical page in the open hash table (or the
+** free entry where it is to be added)
+*/
+static struct pfnent *
+pfnfind(unsigned long long pfn)
+{
+	long	i = (pfn * HPRIME1 >> 20) & (pfnsize - 1);
+
+	while (pfntab[i].pfn && pfntab[i].pfn != pfn)
+		i = (i + 1) & (pfnsize - 1);
+
+	return &pfntab[i];
+}
+
+/*
+** register a physical page of the current process
+*/
+static void
+pfnadd(unsigned long long pfn)
+{
+	struct pfnent	*e, *old;
+	long		i, oldsize;
+
+	if (npfn * 2 >= pfnsize) {		// grow table
+		old     = pfntab;
+		oldsize = pfnsize;
+		pfnsize = pfnsize ? pfnsize * 2 : 65536;
+
+		if ( (pfntab = calloc(pfnsize, sizeof *pfntab)) == NULL) {
+			perror("Can't allocate physical pages");
+			detachproc(pid);
+			exit(1);
+		}
+
+		for (i=0; i < oldsize; i++)
+			if (old[i].pfn)
+				*pfnfind(old[i].pfn) = old[i];
+
+		free(old);
+	}
+
+	procs[curproc].resident++;
+
+	e = pfnfind(pfn);
+
+	if (e->pfn == 0) {
+		e->pfn   = pfn;
+		e->owner = curproc;
+		e->count = 1;
+		npfn++;
+		return;
+	}
+
+	if (e->owner == curproc && e->count > 0) {
+		e->count++;			// mapped twice, not shared
+		return;
+	}
+
+	if (e->count > 0) {			// first mapping by another
+		procs[e->owner].shared += e->count;
+		e->count = -1;
+	}
+
+	procs[curproc].shared++;
+}
+
+/*
+** state of a page for several processes: a page that would be read
+** is PG_SHARED when its physical page has been registered before;
+** with add set the physical page is registered
+*/
+static int
+pfnkind(unsigned long long pme, int add)
+{
+	unsigned long long	pfn = pme & PM_PFN;
+	int			kind = pagekind(pme), seen;
+
+	if (!procs || kind != PG_READ || !(pme & PM_PRESENT) || !pfn)
+		return kind;
+
+	pthread_mutex_lock(&pfnlock);
+
+	seen = pfntab && pfnfind(pfn)->pfn == pfn;
+
+	if (add)
+		pfnadd(pfn);
+
+	pthread_mutex_unlock(&pfnlock);
+
+	return seen ? PG_SHARED : PG_READ;
+}
+
+/*
+** register the physical pages of a range that has been passed as data
+** (or skipped as shared), from the pagemap entries of the snapshot or
+** of the last page run; pages that could not be read are not shown
+** and therefore not registered
+*/
+static void
+pfnshown(struct arange *a, long long addr, long long len)
+{
+	long long	pg, last = (addr + len - 1) / pagesize,
+			base = (long long)a->start / pagesize;
+
+	if (!procs || len <= 0)
+		return;
+
+	for (pg = addr / pagesize; pg <= last; pg++) {
+		if (a->pme)
+			pfnkind(a->pme[pg - base], 1);
+		else if (pg >= pmfirst && pg < pmfirst + pmpages)
+			pfnkind(pmbuf[pg - pmfirst], 1);
+	}
+}
+
+/*
+** add a process and (with --tree) its descendants to the list
+*/
+static int
+addtree(long ppid, long **pids, int npids, int *maxpids)
+{
+	DIR		*dp;
+	struct dirent	*de;
+	long		child;
+	int		i, n, root = npids, first = npids;
+
+	if (npids == *maxpids) {
+		*maxpids = *maxpids ? *maxpids * 2 : 64;
+
+		if ( (*pids = realloc(*pids, *maxpids * sizeof **pids)) == NULL) {
+			perror("Can't allocate process list");
+			exit(1);
+		}
+	}
+
+	(*pids)[npids++] = ppid;
+
+	if (!tree)
+		return npids;
+
+	// breadth-first: children of all processes added so far
+	//
+	for (; first < npids; first++) {
+		if ( (dp = opendir("/proc")) == NULL) {
+			perror("Open /proc");
+			exit(1);
+		}
+
+		while ( (de = readdir(dp)) ) {
+			if (!isdigit(de->d_name[0]))
+				continue;
+
+			child = atol(de->d_name);
+
+			if (parentof(child) != (*pids)[first])
+				continue;
+
+			if (npids == *maxpids) {
+				*maxpids *= 2;
+
+				if ( (*pids = realloc(*pids,
+					*maxpids * sizeof **pids)) == NULL) {
+					perror("Can't allocate process list");
+					exit(1);
+				}
+			}
+
+			(*pids)[npids++] = child;
+		}
+
+		closedir(dp);
+	}
+
+	// descendants that must not be stopped are only passed through
+	//
+	for (i=n=root+1; i < npids; i++)
+		if (!ownproc((*pids)[i]))
+			(*pids)[n++] = (*pids)[i];
+
+	return n;
+}
+
+/*
+** get the parent of a process from /proc/pid/stat
+** returns the pid of the parent or -1
+*/
+static long
+parentof(long pid)
+{
+	char	path[128], buf[512], *p;
+	long	parent;
+	int	fd, n;
+
+	snprintf(path, sizeof path, "/proc/%ld/stat", pid);
+
+	if ( (fd = open(path, O_RDONLY)) == -1)
+		return -1;
+
+	n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+
+	if (n <= 0)
+		return -1;
+
+	buf[n] = '\0';
+
+	// pid (comm) state ppid: comm might contain ')'
+	//
+	if ( (p = strrchr(buf, ')')) == NULL ||
+	     sscanf(p + 1, " %*c %ld", &parent) != 1)
+		return -1;
+
+	return parent;
+}
+
+/*
+** check if a process can not be stopped without stopping pad: pad
+** itself, its ancestors (e.g. a subshell that waits for it) and the
+** processes that use the pipe of pad's standard output (the rest of
+** a pipeline, as in pad --tree $$ | tail)
+*/
+static int
+ownproc(long pid)
+{
+	struct stat	out, st;
+	char		path[128];
+	long		p;
+	int		fd;
+
+	for (p = getpid(); p > 0; p = parentof(p))
+		if (p == pid)
+			return 1;
+
+	if (fstat(1, &out) == -1 || !S_ISFIFO(out.st_mode))
+		return 0;
+
+	for (fd=0; fd <= 2; fd++) {
+		snprintf(path, sizeof path, "/proc/%ld/fd/%d", pid, fd);
+
+		if (stat(path, &st) == 0 && st.st_dev == out.st_dev &&
+					    st.st_ino == out.st_ino)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+** dump (or search, or extract the strings of) several processes one
+** after another, showing physical pages that are shared only once,
+** and report the footprint of every process
+*/
+static void
+multidump(int npids, long pids[])
+{
+	struct proc	*pr;
+	char		path[128];
+	long long	res = 0;
+	long		kib = pagesize / 1024;
+	int		n, fd, nar, len;
+
+	if ( (procs = calloc(npids, sizeof *procs)) == NULL) {
+		perror("Can't allocate processes");
+		exit(1);
+	}
+
+	for (curproc=0; curproc < npids; curproc++) {
+		pr  = &procs[curproc];
+		pid = pr->pid = pids[curproc];
+
+		snprintf(path, sizeof path, "/proc/%ld/comm", pr->pid);
+
+		if ( (fd = open(path, O_RDONLY)) != -1) {
+			if ( (len = read(fd, pr->comm, sizeof pr->comm - 1)) > 0)
+				pr->comm[len - 1] = '\0';	// newline
+			close(fd);
+		}
+
+		if (attachproc(pid) == -1)
+			continue;			// terminated meanwhile
+
+		if ( (nar = getaddranges(pid, &ar, &maxar)) == -1) {
+			releaseproc(pid, ar, 0);
+			continue;
+		}
+
+		if (accmode == ACC_CONSIST) {
+			snapshot(pid, ar, nar);
+			thawproc();
+		}
+
+		if (!search && !minstr)
+			outprintf("============  pid=%ld  %s\n\n", pr->pid, pr->comm);
+
+		showareas(ar, nar);
+		releaseproc(pid, ar, nar);
+
+		pr->done = 1;
+	}
+
+	if (search)
+		outprintf("%lld matches\n", search->nmatch);
+
+	if (minstr)
+		outprintf("%lld strings\n", nstrings);
+
+	// footprints (only known with the physical pages)
+	//
+	if (npfn == 0) {
+		outprintf("\nphysical pages not visible in pagemap (requires "
+			  "CAP_SYS_ADMIN): shared pages shown per process\n");
+		free(procs);
+		procs = NULL;
+		return;
+	}
+
+	outprintf("\n    PID    RESIDENT     PRIVATE      SHARED  COMMAND   (KiB)\n");
+
+	for (n=0; n < npids; n++) {
+		pr = &procs[n];
+
+		if (!pr->done)
+			continue;
+
+		outprintf("%7ld  %10lld  %10lld  %10lld  %s\n", pr->pid,
+			pr->resident * kib, (pr->resident - pr->shared) * kib,
+			pr->shared * kib, pr->comm);
+
+		res += pr->resident;
+	}
+
+	outprintf("%lld KiB resident in total, %lld KiB in different "
+		  "physical pages (shown once)\n", res * kib, npfn * kib);
+
+	free(procs);
+	free(pfntab);
+	procs = NULL;
+}
+
+
+/*
+** growable buffer for the notes of an ELF core file
+*/
+struct notes {
+	char	*buf;
+	long	len, size;
+};
+
+/*
+** add one note (name "CORE") to the notes buffer
+*/
+static void
+addnote(struct notes *nb, int type, void *desc, long descsz)
+{
+	Elf64_Nhdr	nh;
+	long		need = sizeof nh + 8 + ((descsz + 3) & ~3);
+
+	if (nb->len + need > nb->size) {
+		nb->size = (nb->len + need) * 2;
+
+		if ( (nb->buf = realloc(nb->buf, nb->size)) == NULL) {
+			perror("Can't allocate notes");
+			detachproc(pid);
+			exit(1);
+		}
+	}
+
+	nh.n_namesz = 5;		// "CORE" including null byte
+	nh.n_descsz = descsz;
+	nh.n_type   = type;
+
+	memset(nb->buf + nb->len, 0, need);
+	memcpy(nb->buf + nb->len, &nh, sizeof nh);
+	memcpy(nb->buf + nb->len + sizeof nh, "CORE", 5);
+	memcpy(nb->buf + nb->len + sizeof nh + 8, desc, descsz);
+
+	nb->len += need;
+}
+
+/*
+** read a complete (small) file from /proc into a malloc'ed buffer
+** returns the number of bytes read or -1
+*/
+static long
+readproc(char *file, char **buf)
+{
+	char	path[128];
+	long	len = 0, size = 4096, n;
+	int	fd;
+
+	snprintf(path, sizeof path, "/proc/%lld/%s", pid, file);
+
+	if ( (fd = open(path, O_RDONLY)) == -1)
+		return -1;
+
+	*buf = malloc(size);
+
+	while (*buf && (n = read(fd, *buf + len, size - len)) > 0) {
+		len += n;
+
+		if (len == size)
+			*buf = realloc(*buf, size *= 2);
+	}
+
+	close(fd);
+
+	return *buf ? len : -1;
+}
+
+/*
+** build the notes of an ELF core file: process info, the registers
+** of every stopped thread, the auxiliary vector and the mapped files
+*/
+static void
+corenotes(struct notes *nb, struct arange ar[], int nar)
+{
+	struct elf_prpsinfo	psinfo;
+	struct elf_prstatus	prstatus;
+	char			*buf;
+	long			len, i, nfile, *fv;
+	int			t, found = 0;
+
+	// process info
+	//
+	memset(&psinfo, 0, sizeof psinfo);
+	psinfo.pr_pid = pid;
+
+	if ( (len = readproc("comm", &buf)) > 0) {
+		buf[len-1] = '\0';
+		strncpy(psinfo.pr_fname, buf, sizeof psinfo.pr_fname - 1);
+		free(buf);
+	}
+
+	if ( (len = readproc("cmdline", &buf)) > 0) {
+		for (i=0; i < len-1; i++)
+			if (buf[i] == '\0')
+				buf[i] = ' ';
+
+		strncpy(psinfo.pr_psargs, buf, sizeof psinfo.pr_psargs - 1);
+		free(buf);
+	}
+
+	addnote(nb, NT_PRPSINFO, &psinfo, sizeof psinfo);
+
+	// registers of all threads that have been stopped, the main
+	// thread first (at least one status note is required by gdb)
+	//
+	for (t=0; t < ntasks; t++) {
+		if (!tasks[t].hasregs)
+			continue;
+
+		memset(&prstatus, 0, sizeof prstatus);
+		prstatus.pr_pid = tasks[t].tid;
+		memcpy(&prstatus.pr_reg, &tasks[t].regs, sizeof prstatus.pr_reg);
+
+		addnote(nb, NT_PRSTATUS, &prstatus, sizeof prstatus);
+		found++;
+	}
+
+	if (!found) {
+		memset(&prstatus, 0, sizeof prstatus);
+		prstatus.pr_pid = pid;
+		addnote(nb, NT_PRSTATUS, &prstatus, sizeof prstatus);
+	}
+
+	// auxiliary vector
+	//
+	if ( (len = readproc("auxv", &buf)) > 0) {
+		addnote(nb, NT_AUXV, buf, len);
+		free(buf);
+	}
+
+	// mapped files: count, page size, triplets of start, end and
+	// file offset (in pages), followed by the file names
+	//
+	for (i=nfile=0, len=0; i < nar; i++) {
+		if (ar[i].name[0] == '/') {
+			nfile++;
+			len += strlen(ar[i].name) + 1;
+		}
+	}
+
+	if (nfile) {
+		fv = calloc(1, (2 + 3*nfile) * sizeof(long) + len);
+		fv[0] = nfile;
+		fv[1] = pagesize;
+		buf   = (char *)&fv[2 + 3*nfile];
+
+		for (i=0, nfile=0; i < nar; i++) {
+			if (ar[i].name[0] != '/')
+				continue;
+
+			fv[2 + 3*nfile] = (long)ar[i].start;
+			fv[3 + 3*nfile] = (long)ar[i].start + ar[i].length;
+			fv[4 + 3*nfile] = ar[i].offset / pagesize;
+			nfile++;
+
+			strcpy(buf, ar[i].name);
+			buf += strlen(ar[i].name) + 1;
+		}
+
+		addnote(nb, NT_FILE, fv, buf - (char *)fv);
+		free(fv);
+	}
+}
+
+/*
+** write an ELF core file with one PT_LOAD segment per area
+*/
+static void
+writecore(char *path, struct arange ar[], int nar)
+{
+	Elf64_Ehdr	eh;
+	Elf64_Phdr	*ph;
+	struct notes	nb = { NULL, 0, 0 };
+	struct fileout	fo;
+	long long	off;
+	int		i, nph = 1;
+
+	if ( (fo.fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0600)) == -1) {
+		perror(path);
+		detachproc(pid);
+		exit(1);
+	}
+
+	corenotes(&nb, ar, nar);
+	fo.hash = NULL;			// no page hashes in core file
+
+	if ( (ph = calloc(nar + 1, sizeof *ph)) == NULL) {
+		perror("Can't allocate program headers");
+		detachproc(pid);
+		exit(1);
+	}
+
+	// program headers: notes first and then the loadable segments
+	// at page-aligned file offsets
+	//
+	off = sizeof eh + (nar + 1) * sizeof *ph;
+
+	ph[0].p_type   = PT_NOTE;
+	ph[0].p_offset = off;
+	ph[0].p_filesz = nb.len;
+	ph[0].p_align  = 4;
+
+	off = (off + nb.len + pagesize - 1) / pagesize * pagesize;
+
+	for (i=0; i < nar; i++) {
+		if (strcmp(ar[i].name, "[vsyscall]") == 0)
+			continue;	// not part of the address space
+
+		ph[nph].p_type   = PT_LOAD;
+		ph[nph].p_offset = off;
+		ph[nph].p_vaddr  = (long long)ar[i].start;
+		ph[nph].p_filesz = ar[i].length;
+		ph[nph].p_memsz  = ar[i].length;
+		ph[nph].p_align  = pagesize;
+		ph[nph].p_flags  = (ar[i].perm[0] == 'r' ? PF_R : 0) |
+		                   (ar[i].perm[1] == 'w' ? PF_W : 0) |
+		                   (ar[i].perm[2] == 'x' ? PF_X : 0);
+
+		fo.off = off;
+		parwalk(&ar[i], filechunk, skiphole, &fo, 1, 0);
+
+		off += ar[i].length;
+		nph++;
+	}
+
+	// ELF header
+	//
+	memset(&eh, 0, sizeof eh);
+	memcpy(eh.e_ident, ELFMAG, SELFMAG);
+	eh.e_ident[EI_CLASS]   = ELFCLASS64;
+	eh.e_ident[EI_DATA]    = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_ident[EI_OSABI]   = ELFOSABI_NONE;
+#if	__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	eh.e_ident[EI_DATA]    = ELFDATA2MSB;
+#endif
+	eh.e_type      = ET_CORE;
+	eh.e_machine   = ELF_MACHINE;
+	eh.e_version   = EV_CURRENT;
+	eh.e_phoff     = sizeof eh;
+	eh.e_ehsize    = sizeof eh;
+	eh.e_phentsize = sizeof *ph;
+	eh.e_phnum     = nph;
+
+	if (pwrite(fo.fd, &eh, sizeof eh, 0) != sizeof eh ||
+	    pwrite(fo.fd, ph, nph * sizeof *ph, sizeof eh) !=
+						nph * sizeof *ph ||
+	    pwrite(fo.fd, nb.buf, nb.len, ph[0].p_offset) != nb.len ||
+	    ftruncate(fo.fd, off) == -1) {
+		perror("Write core file");
+		detachproc(pid);
+		exit(1);
+	}
+
+	close(fo.fd);
+	free(nb.buf);
+	free(ph);
+}
+
+
+/*
+** address index for annotation: all mapped areas (also the ones that
+** are not dumped) and the symbols of the mapped ELF files, both
+** sorted by address
+*/
+struct symbol {
+	long long	addr, size;
+	char		*name;		// in mapped symbol string table
+	char		*file;		// short name of ELF file
+};
+
+struct symbol	*syms;
+long		nsyms, maxsyms;
+
+struct arange	*mapar;			// all areas
+int		nmapar, maxmapar;
+
+/*
+** find the area containing addr (binary search)
+*/
+static struct arange *
+findarea(struct arange *tab, int n, long long addr)
+{
+	int	lo = 0, hi = n - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+
+		if ((unsigned long long)addr <
+				(unsigned long long)tab[mid].start)
+			hi = mid - 1;
+		else if ((unsigned long long)addr >=
+			 (unsigned long long)tab[mid].start + tab[mid].length)
+			lo = mid + 1;
+		else
+			return &tab[mid];
+	}
+
+	return NULL;
+}
+
+/*
+** find the symbol containing addr (a symbol without size only
+** contains its own address)
+*/
+static struct symbol *
+findsym(long long addr)
+{
+	long	lo = 0, hi = nsyms - 1, mid;
+
+	while (lo <= hi) {			// last symbol <= addr
+		mid = (lo + hi) / 2;
+
+		if (syms[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	if (hi < 0)
+		return NULL;
+
+	if (addr < syms[hi].addr + (syms[hi].size ? syms[hi].size : 1))
+		return &syms[hi];
+
+	return NULL;
+}
+
+/*
+** find the first symbol at or after addr (end of the table if none)
+*/
+static struct symbol *
+firstsym(long long addr)
+{
+	long	lo = 0, hi = nsyms, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (syms[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return &syms[lo];
+}
+
+static int
+symcmp(const void *a, const void *b)
+{
+	const struct symbol	*sa = a, *sb = b;
+
+	if (sa->addr != sb->addr)
+		return sa->addr < sb->addr ? -1 : 1;
+
+	return (sa->size < sb->size) - (sa->size > sb->size);	// largest first
+}
+
+/*
+** add the function and object symbols of one mapped ELF file
+*/
+static void
+elfsymbols(long pid, struct arange *a)
+{
+	char		path[PATH_MAX], *file, *strtab, *base;
+	struct stat	st;
+	Elf64_Ehdr	*eh;
+	Elf64_Shdr	*sh;
+	Elf64_Phdr	*ph;
+	Elf64_Sym	*sym;
+	long long	bias = 0;
+	long		nsym, i;
+	int		fd, s, type;
+
+	// open via map_files to find deleted files as well
+	//
+	snprintf(path, sizeof path, "/proc/%ld/map_files/%llx-%llx", pid,
+		(long long)a->start, (long long)a->start + a->length);
+
+	if ( (fd = open(path, O_RDONLY)) == -1 &&
+	     (fd = open(a->name, O_RDONLY)) == -1)
+		return;
+
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof *eh ||
+	    (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+							== MAP_FAILED) {
+		close(fd);
+		return;
+	}
+
+	close(fd);
+
+	eh = (Elf64_Ehdr *)base;
+
+	if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh->e_shoff + eh->e_shnum * sizeof *sh > st.st_size ||
+	    eh->e_phoff + eh->e_phnum * sizeof *ph > st.st_size) {
+		munmap(base, st.st_size);
+		return;
+	}
+
+	// load bias of position-independent files: mapped address of
+	// the segment at file offset 0
+	//
+	if (eh->e_type == ET_DYN) {
+		ph = (Elf64_Phdr *)(base + eh->e_phoff);
+
+		for (i=0; i < eh->e_phnum; i++) {
+			if (ph[i].p_type == PT_LOAD && ph[i].p_offset == 0) {
+				bias = (long long)a->start -
+					(ph[i].p_vaddr & ~(pagesize - 1));
+				break;
+			}
+		}
+	}
+
+	file = strrchr(a->name, '/') + 1;
+	sh   = (Elf64_Shdr *)(base + eh->e_shoff);
+
+	for (s=0; s < eh->e_shnum; s++) {
+		if (sh[s].sh_type != SHT_SYMTAB && sh[s].sh_type != SHT_DYNSYM)
+			continue;
+
+		if (sh[s].sh_link >= eh->e_shnum ||
+		    sh[s].sh_offset + sh[s].sh_size > st.st_size ||
+		    sh[sh[s].sh_link].sh_offset +
+				sh[sh[s].sh_link].sh_size > st.st_size)
+			continue;
+
+		sym    = (Elf64_Sym *)(base + sh[s].sh_offset);
+		nsym   = sh[s].sh_size / sizeof *sym;
+		strtab = base + sh[sh[s].sh_link].sh_offset;
+
+		for (i=0; i < nsym; i++) {
+			type = ELF64_ST_TYPE(sym[i].st_info);
+
+			if ((type != STT_FUNC && type != STT_OBJECT) ||
+			    sym[i].st_shndx == SHN_UNDEF || sym[i].st_value == 0 ||
+			    sym[i].st_name >= sh[sh[s].sh_link].sh_size)
+				continue;
+
+			if (nsyms == maxsyms) {
+				maxsyms = maxsyms ? maxsyms * 2 : 65536;
+
+				if ( (syms = realloc(syms,
+					maxsyms * sizeof *syms)) == NULL) {
+					perror("Can't allocate symbols");
+					exit(1);
+				}
+			}
+
+			syms[nsyms].addr = sym[i].st_value + bias;
+			syms[nsyms].size = sym[i].st_size;
+			syms[nsyms].name = strtab + sym[i].st_name;
+			syms[nsyms].file = file;
+			nsyms++;
+		}
+	}
+}
+
+/*
+** build the address index of all areas of a process (also the ones
+** that are not selected by --only and --perm, and special areas)
+*/
+static void
+loadareas(long pid)
+{
+	if ( (nmapar = readareas(pid, &mapar, &maxmapar)) == -1)
+		nmapar = 0;
+}
+
+/*
+** build the address index of all areas and symbols of a process
+*/
+static void
+loadsymbols(long pid)
+{
+	long	i, n;
+
+	loadareas(pid);
+
+	for (i=0; i < nmapar; i++)
+		if (mapar[i].name[0] == '/' && mapar[i].offset == 0)
+			elfsymbols(pid, &mapar[i]);
+
+	// sort and remove duplicates (.symtab and .dynsym overlap)
+	//
+	qsort(syms, nsyms, sizeof *syms, symcmp);
+
+	for (i=n=0; i < nsyms; i++)
+		if (n == 0 || syms[i].addr != syms[n-1].addr)
+			syms[n++] = syms[i];
+
+	nsyms = n;
+}
+
+/*
+** add annotations to the dump line that has just been formatted:
+** symbols that start in the line and words that point into an area
+*/
+static void
+annotline(long long addr, unsigned char *buf, int len)
+{
+	struct symbol	*sym;
+	struct arange	*a;
+	long long	val;
+	char		*name;
+	int		i;
+
+	out.len--;			// remove newline
+
+	// symbols starting in this line
+	//
+	for (sym = firstsym(addr); sym < syms + nsyms &&
+					sym->addr < addr + len; sym++)
+		outprintf("  <%s>", sym->name);
+
+	// 8-byte aligned words pointing into an area
+	//
+	for (i = (8 - addr % 8) % 8; i + 8 <= len; i += 8) {
+		memcpy(&val, buf + i, 8);
+
+		if ( (a = findarea(mapar, nmapar, val)) == NULL)
+			continue;
+
+		if ( (sym = findsym(val)) ) {
+			outprintf("  [+%d]=%s:%s", i, sym->file, sym->name);
+
+			if (val != sym->addr)
+				outprintf("+0x%llx", val - sym->addr);
+		} else {
+			name = strrchr(a->name, '/') ? strrchr(a->name, '/') + 1 :
+			       a->name[0] ? a->name : "[anon]";
+
+			outprintf("  [+%d]=%s+0x%llx", i, name,
+					val - (long long)a->start);
+		}
+	}
+
+	outprintf("\n");
+}
+
+/*
+** blocks of the glibc malloc heaps (--pointers and --heap), found by
+** walking the chunk headers (size field with flag bits in the word
+** before the user data) of the [heap] area of the main arena, of the
+** heaps of the other arenas (mmapped areas aligned to HEAP_MAX that
+** start with a heap_info structure) and of the chunks that are
+** mmapped on their own; the offsets below are those of 64-bit
+** glibc 2.30 and later
+*/
+struct block {
+	long long	addr, size;	// chunk header and chunk size
+	long		refs;		// pointers into this block
+	char		used;
+	char		reach;		// reachable from registers or areas
+	char		kind;		// BL_...
+};
+
+#define	BL_CHUNK	0
+#define	BL_TOP		1		// top chunk of a heap (free)
+#define	BL_CACHED	2		// free in tcache or fastbin
+#define	BL_MMAP		3		// mmapped chunk (in use)
+
+struct block	*blocks;
+long		nblocks, maxblocks;
+
+struct heap {
+	long long	start, end;	// range of chunks
+	long long	arena;		// malloc_state (0: unknown, -1: mmap)
+	long		first, last;	// blocks of this heap
+	char		main;		// [heap] of the main arena
+};
+
+struct heap	*heaps;
+int		nheaps, maxheaps;
+
+#define	CHUNKHDR	16		// prev_size and size fields
+#define	MINCHUNK	32
+#define	IS_MMAPPED	2
+#define	HEAP_MAX	(64LL*1024*1024)
+#define	HEAPINFO	32		// ar_ptr, prev, size, mprotect_size
+#define	HEAPINFO2	48		// and pagesize (glibc 2.35)
+#define	AR_FASTBINS	16		// offsets in struct malloc_state
+#define	AR_TOP		96
+#define	AR_NEXT		2160
+#define	AR_SIZE		2200
+#define	NFASTBINS	10
+#define	TCACHEBINS	64
+#define	TCACHESIZE	(CHUNKHDR + TCACHEBINS * (2 + 8))
+
+struct heapwalk {
+	long long	next;		// address of next chunk header
+	long long	end;		// end of heap
+	long		first;		// first block of heap
+	int		lost;		// chunk headers out of sync
+};
+
+/*
+** read len bytes of the target from one of the given areas
+** returns 1 when all bytes could be read
+*/
+static int
+heapread(struct arange ar[], int nar, long long addr, void *buf, long len)
+{
+	struct arange	*a;
+
+	if ( (a = findarea(ar, nar, addr)) == NULL)
+		return 0;
+
+	return memread(a, addr, buf, len) == len;
+}
+
+/*
+** find the heap block containing addr (binary search)
+*/
+static struct block *
+findblock(long long addr)
+{
+	long	lo = 0, hi = nblocks - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+
+		if (addr < blocks[mid].addr)
+			hi = mid - 1;
+		else if (addr >= blocks[mid].addr + blocks[mid].size)
+			lo = mid + 1;
+		else
+			return &blocks[mid];
+	}
+
+	return NULL;
+}
+
+/*
+** check if an area contains a heap or an mmapped chunk (binary search)
+*/
+static int
+heaparea(struct arange *a)
+{
+	int	lo = 0, hi = nheaps - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+
+		if (heaps[mid].end <= (long long)a->start)
+			lo = mid + 1;
+		else if (heaps[mid].start >= (long long)a->start + a->length)
+			hi = mid - 1;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+static struct block *
+addblock(long long addr, long long size, int kind)
+{
+	if (nblocks == maxblocks) {
+		maxblocks = maxblocks ? maxblocks * 2 : 65536;
+
+		if ( (blocks = realloc(blocks, maxblocks * sizeof *blocks))
+								== NULL) {
+			perror("Can't allocate heap blocks");
+			detachproc(pid);
+			exit(1);
+		}
+	}
+
+	blocks[nblocks].addr  = addr;
+	blocks[nblocks].size  = size;
+	blocks[nblocks].refs  = 0;
+	blocks[nblocks].used  = 1;
+	blocks[nblocks].reach = 0;
+	blocks[nblocks].kind  = kind;
+
+	return &blocks[nblocks++];
+}
+
+static struct heap *
+addheap(long long start, long long end, long long arena)
+{
+	if (nheaps == maxheaps) {
+		maxheaps = maxheaps ? maxheaps * 2 : 64;
+
+		if ( (heaps = realloc(heaps, maxheaps * sizeof *heaps)) == NULL) {
+			perror("Can't allocate heaps");
+			detachproc(pid);
+			exit(1);
+		}
+	}
+
+	heaps[nheaps].start = start;
+	heaps[nheaps].end   = end;
+	heaps[nheaps].arena = arena;
+	heaps[nheaps].main  = 0;
+	heaps[nheaps].first = heaps[nheaps].last = nblocks;
+
+	return &heaps[nheaps++];
+}
+
+/*
+** register the chunks of which the header is in a chunk of data; a
+** chunk is in use when the next chunk has the PREV_INUSE bit set
+*/
+static void
+heapchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct heapwalk	*hw = arg;
+	long long	size;
+
+	while (!hw->lost && hw->next < hw->end) {
+		if (hw->next < addr) {		// header in skipped range
+			hw->lost = 1;
+			break;
+		}
+
+		if (hw->next + CHUNKHDR > addr + len)
+			break;			// header in next chunk of data
+
+		memcpy(&size, buf + (hw->next - addr) + 8, sizeof size);
+
+		if (nblocks > hw->first)
+			blocks[nblocks-1].used = size & 1;
+
+		size &= ~7LL;
+
+		// fencepost at the end of an older heap of an arena, or
+		// end of the top chunk of the main arena before the end of
+		// its last page
+		//
+		if (size == CHUNKHDR ||
+		    (size == 0 && hw->end - hw->next < pagesize)) {
+			hw->end = hw->next;
+			break;
+		}
+
+		if (size < MINCHUNK || size % CHUNKHDR ||
+		    hw->next + size > hw->end) {
+			hw->lost = 1;
+			break;
+		}
+
+		addblock(hw->next, size, BL_CHUNK);
+		hw->next += size;
+	}
+}
+
+static void
+heaphole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+}
+
+/*
+** walk the chunks of a heap; the last chunk of the most recent heap
+** of an arena (top) is free
+*/
+static void
+heapblocks(struct arange *a, struct heap *h)
+{
+	struct heapwalk	hw;
+
+	hw.next  = h->start;
+	hw.end   = h->end;
+	hw.first = nblocks;
+	hw.lost  = 0;
+
+	walkrange(a, h->start, h->end, heapchunk, heaphole, &hw, 1);
+
+	if (hw.lost || hw.next < hw.end)
+		outprintf("heap walk of %s stopped at %llx "
+			  "(chunk header not readable or corrupt)\n",
+			  a->name[0] ? a->name : "[anon]", hw.next);
+	else if (nblocks > hw.first && hw.end == h->end) {
+		blocks[nblocks-1].used = 0;
+		blocks[nblocks-1].kind = BL_TOP;
+	}
+
+	h->last = nblocks;
+}
+
+/*
+** check if addr is the address of a chunk (with offset off of the
+** pointer to the chunk) that is in use according to the walk
+*/
+static struct block *
+chunkat(long long addr, long off)
+{
+	struct block	*b = findblock(addr - off);
+
+	return b && b->addr == addr - off && b->used ? b : NULL;
+}
+
+/*
+** mark the chunks of a singly linked list of free chunks (tcache or
+** fastbin) as cached; the link in the first word of the user data
+** is mangled (safe-linking since glibc 2.32) or not
+*/
+static void
+cachelist(struct arange ar[], int nar, long long p, long off, long max)
+{
+	struct block	*b;
+	long long	next;
+
+	while (max-- > 0 && (b = chunkat(p, off)) ) {
+		b->used = 0;
+		b->kind = BL_CACHED;
+
+		if (!heapread(ar, nar, b->addr + CHUNKHDR, &next, sizeof next) ||
+		    next == 0)
+			break;
+
+		if (chunkat(next, off))
+			p = next;
+		else
+			p = ((b->addr + CHUNKHDR) >> 12) ^ next;
+	}
+}
+
+/*
+** find the chunk lists of a tcache_perthread_struct (uint16 counts
+** and pointers to user data per bin) in a block in use of that size
+*/
+static void
+tcachelists(struct arange ar[], int nar, struct block *b)
+{
+	unsigned short	count[TCACHEBINS];
+	long long	entry[TCACHEBINS];
+	int		i;
+
+	if (!heapread(ar, nar, b->addr + CHUNKHDR, count, sizeof count) ||
+	    !heapread(ar, nar, b->addr + CHUNKHDR + sizeof count, entry,
+							sizeof entry))
+		return;
+
+	for (i=0; i < TCACHEBINS; i++)
+		if ((count[i] == 0) != (entry[i] == 0) ||
+		    (entry[i] && !chunkat(entry[i], CHUNKHDR)))
+			return;			// no tcache
+
+	for (i=0; i < TCACHEBINS; i++)
+		cachelist(ar, nar, entry[i], CHUNKHDR, count[i]);
+}
+
+/*
+** locate the malloc_state of the main arena in a writable area of a
+** file (data of libc) or the anonymous area that follows it (bss) via
+** its pointer to the top chunk of [heap], and verify that its list of
+** arenas leads to itself or another arena
+*/
+static long long
+mainarena(struct arange ar[], int nar, long long top)
+{
+	long long	*w, next, addr;
+	long		n, i;
+	int		j, h;
+
+	for (i=0; i < nar; i++) {
+		if (ar[i].perm[1] != 'w' || (ar[i].name[0] != '/' &&
+		    (i == 0 || ar[i-1].name[0] != '/' ||
+		     (long long)ar[i-1].start + ar[i-1].length !=
+						(long long)ar[i].start)))
+			continue;
+
+		for (addr = (long long)ar[i].start;
+		     addr < (long long)ar[i].start + ar[i].length; addr += n) {
+			if ( (n = memread(&ar[i], addr, chunkbuf, CHUNKSIZE >
+			      (long long)ar[i].start + ar[i].length - addr ?
+			      (long long)ar[i].start + ar[i].length - addr :
+			      CHUNKSIZE)) == 0)
+				break;
+
+			for (w = (long long *)chunkbuf, j=0; j < n / 8; j++) {
+				if (w[j] != top)
+					continue;
+
+				if (!heapread(ar, nar, addr + j*8 - AR_TOP +
+						AR_NEXT, &next, sizeof next))
+					continue;
+
+				if (next == addr + j*8 - AR_TOP)
+					return next;
+
+				for (h=0; h < nheaps; h++)
+					if (heaps[h].arena == next)
+						return addr + j*8 - AR_TOP;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+** find and walk all heaps in the writable areas: [heap], heaps of
+** other arenas and mmapped chunks; afterwards the free chunks in the
+** tcaches and fastbins are marked as cached
+*/
+static void
+heapscan(struct arange ar[], int nar)
+{
+	struct heap	*h;
+	struct block	*b;
+	long long	info[4], hdr[2], fast[NFASTBINS];
+	long long	start, end, addr, hinfo;
+	int		i, j;
+
+	for (i=0; i < nar; i++) {
+		start = (long long)ar[i].start;
+		end   = start + ar[i].length;
+
+		if (ar[i].perm[1] != 'w')
+			continue;
+
+		if (strcmp(ar[i].name, "[heap]") == 0) {
+			h = addheap(start, end, 0);
+			h->main = 1;
+			heapblocks(&ar[i], h);
+			continue;
+		}
+
+		if (ar[i].name[0] != '\0' ||
+		    !heapread(ar, nar, start, info, sizeof info))
+			continue;
+
+		// heap of another arena: heap_info with ar_ptr, prev and
+		// size; the malloc_state (ar_ptr) of the arena follows the
+		// heap_info of its first heap
+		//
+		hinfo = info[0] % HEAP_MAX;
+
+		if (start % HEAP_MAX == 0 && info[2] > 0 && info[2] <= end - start &&
+		    (hinfo == HEAPINFO || hinfo == HEAPINFO2) &&
+		    (info[0] == start + hinfo ||
+		     (info[1] && info[1] % HEAP_MAX == 0))) {
+			if (info[0] == start + hinfo)		// first heap
+				h = addheap((info[0] + AR_SIZE + CHUNKHDR - 1) &
+					~(CHUNKHDR - 1LL), start + info[2], info[0]);
+			else
+				h = addheap(start + hinfo, start + info[2],
+								info[0]);
+
+			heapblocks(&ar[i], h);
+			continue;
+		}
+
+		// mmapped chunks (adjacent mappings are merged in one
+		// area): prev_size is the offset of the chunk in its mapping
+		//
+		for (addr = start, h = NULL; addr < end; addr += hdr[0] + hdr[1]) {
+			if (!heapread(ar, nar, addr, hdr, sizeof hdr) ||
+			    !(hdr[1] & IS_MMAPPED))
+				break;
+
+			hdr[1] &= ~7LL;
+
+			if (hdr[0] < 0 || hdr[0] % CHUNKHDR || hdr[1] < pagesize ||
+			    addr + hdr[0] + hdr[1] > end)
+				break;
+
+			if (!h)
+				h = addheap(addr + hdr[0], end, -1);
+
+			addblock(addr + hdr[0], hdr[1], BL_MMAP);
+			h->end  = addr + hdr[0] + hdr[1];
+			h->last = nblocks;
+		}
+	}
+
+	// main arena via the top chunk of [heap]
+	//
+	for (i=0; i < nheaps; i++) {
+		h = &heaps[i];
+
+		if (h->main && h->last > h->first &&
+		    blocks[h->last - 1].kind == BL_TOP)
+			h->arena = mainarena(ar, nar, blocks[h->last - 1].addr);
+	}
+
+	// free chunks in the fastbins of every arena and in tcaches
+	//
+	for (i=0; i < nheaps; i++) {
+		if (heaps[i].arena <= 0)
+			continue;
+
+		for (j=0; j < i && heaps[j].arena != heaps[i].arena; j++)
+			;
+
+		if (j < i || !heapread(ar, nar, heaps[i].arena + AR_FASTBINS,
+							fast, sizeof fast))
+			continue;
+
+		for (j=0; j < NFASTBINS; j++)
+			cachelist(ar, nar, fast[j], 0, nblocks);
+	}
+
+	for (b=blocks; b < blocks + nblocks; b++)
+		if (b->used && b->kind == BL_CHUNK && b->size == TCACHESIZE)
+			tcachelists(ar, nar, b);
+}
+
+/*
+** size class of a chunk for the histogram: 32, 64, 128, ... bytes
+*/
+#define	NSIZECLASS	24
+
+static int
+sizeclass(long long size)
+{
+	int	c;
+
+	for (c=0; c < NSIZECLASS - 1 && size > (MINCHUNK << c); c++)
+		;
+
+	return c;
+}
+
+/*
+** order free blocks by size (largest first)
+*/
+static int
+sizecmp(const void *a, const void *b)
+{
+	const struct block	*ba = &blocks[*(long *)a], *bb = &blocks[*(long *)b];
+
+	if (ba->size != bb->size)
+		return ba->size < bb->size ? 1 : -1;
+
+	return ba->addr < bb->addr ? -1 : 1;
+}
+
+/*
+** statistics of one arena (or of all mmapped chunks)
+*/
+struct arenastat {
+	long long	arena;
+	char		main;
+	int		nheap;
+	long long	size;
+	long long	nused, used, nfree, free, ncached, top, largest;
+};
+
+#define	NLARGEST	10
+
+/*
+** report the composition of the malloc heaps: per arena the chunks
+** in use and free, the fragmentation of the free memory (without the
+** top chunk) and a histogram of chunk sizes
+*/
+static void
+heapreport(struct arange ar[], int nar)
+{
+	struct arenastat	*st = NULL, *s;
+	struct heap		*h;
+	struct block		*b;
+	long long		hist[NSIZECLASS][4];
+	long			*fr, nfr = 0;
+	int			i, j, n = 0, c;
+
+	memset(hist, 0, sizeof hist);
+
+	heapscan(ar, nar);
+
+	if ( (st = calloc(nheaps + 1, sizeof *st)) == NULL ||
+	     (fr = malloc((nblocks + 1) * sizeof *fr)) == NULL) {
+		perror("Can't allocate arena statistics");
+		detachproc(pid);
+		exit(1);
+	}
+
+	for (i=0; i < nheaps; i++) {
+		h = &heaps[i];
+
+		for (j=0; j < n && st[j].arena != h->arena; j++)
+			;
+
+		s = &st[j];
+
+		if (j == n) {
+			s->arena = h->arena;
+			s->main  = h->main;
+			n++;
+		}
+
+		s->nheap++;
+		s->size += h->end - h->start;
+
+		for (b = &blocks[h->first]; b < &blocks[h->last]; b++) {
+			c = sizeclass(b->size);
+
+			if (b->used) {
+				s->nused++;
+				s->used += b->size;
+				hist[c][0]++;
+				hist[c][1] += b->size;
+				continue;
+			}
+
+			if (b->kind == BL_TOP) {
+				s->top += b->size;
+				continue;
+			}
+
+			s->nfree++;
+			s->free += b->size;
+			hist[c][2]++;
+			hist[c][3] += b->size;
+
+			if (b->kind == BL_CACHED)
+				s->ncached++;
+
+			if (b->size > s->largest)
+				s->largest = b->size;
+
+			fr[nfr++] = b - blocks;
+		}
+	}
+
+	// per arena
+	//
+	outprintf("ARENA          HEAPS    SIZEKiB      USED   USEDKiB"
+		  "      FREE   FREEKiB    CACHED    TOPKiB  LARGEST  FRAG\n");
+
+	for (j=0; j < n; j++) {
+		s = &st[j];
+
+		if (s->arena == -1)
+			outprintf("%-12s", "mmapped");
+		else if (s->main)
+			outprintf("%-12s", "main");
+		else
+			outprintf("%012llx", s->arena);
+
+		outprintf("  %5d %10lld %9lld %9lld %9lld %9lld %9lld %9lld"
+			  " %8lld %4.0f%%\n",
+			s->nheap, s->size / 1024, s->nused, s->used / 1024,
+			s->nfree, s->free / 1024, s->ncached, s->top / 1024,
+			s->largest,
+			s->free ? 100.0 - s->largest * 100.0 / s->free : 0.0);
+	}
+
+	// histogram of chunk sizes
+	//
+	outprintf("\nCHUNK SIZE        USED   USEDKiB      FREE   FREEKiB\n");
+
+	for (c=0; c < NSIZECLASS; c++) {
+		if (hist[c][0] == 0 && hist[c][2] == 0)
+			continue;
+
+		if (c < NSIZECLASS - 1)
+			outprintf("<= %-9lld", (long long)MINCHUNK << c);
+		else
+			outprintf(">  %-9lld", (long long)MINCHUNK << (c - 1));
+
+		outprintf("%10lld %9lld %9lld %9lld\n", hist[c][0],
+			hist[c][1] / 1024, hist[c][2], hist[c][3] / 1024);
+	}
+
+	// largest free chunks (top chunks excluded)
+	//
+	if (nfr) {
+		qsort(fr, nfr, sizeof *fr, sizecmp);
+
+		outprintf("\nLARGEST FREE      SIZE  KIND\n");
+
+		for (i=0; i < nfr && i < NLARGEST; i++) {
+			b = &blocks[fr[i]];
+
+			outprintf("%012llx  %9lld  %s\n", b->addr, b->size,
+				b->kind == BL_CACHED ? "tcache/fastbin" : "bin");
+		}
+	}
+
+	free(fr);
+	free(st);
+}
+
+/*
+** pointer graph (--pointers): counters of the pointers found per area
+** and per class of source and target area
+*/
+#define	CL_HEAP		0
+#define	CL_STACK	1
+#define	CL_ANON		2
+#define	CL_FILE		3
+#define	CL_OTHER	4
+#define	CL_REGS		5		// source only: thread registers
+#define	NCLASS		6
+
+char	*clname[] = { "heap", "stack", "anon", "file", "other", "regs" };
+
+struct ptrscan {
+	long long	*in, *out;	// pointers into and from every area
+	long long	words;
+	long long	edge[NCLASS][NCLASS];
+	long		*work;		// reachable blocks to be scanned
+	long		nwork;
+};
+
+/*
+** class of an area as source or target of pointers
+*/
+static int
+areaclass(struct arange *a)
+{
+	if (heaparea(a))
+		return CL_HEAP;
+
+	if (strncmp(a->name, "[stack", 6) == 0)
+		return CL_STACK;
+
+	if (a->name[0] == '\0' || strncmp(a->name, "[anon", 5) == 0)
+		return CL_ANON;
+
+	if (a->name[0] == '/')
+		return CL_FILE;
+
+	return CL_OTHER;
+}
+
+/*
+** count a word that points into a mapped area and register a
+** reference to the heap block it points into; a block referenced by
+** a root (registers or an area that is not a heap) is reachable
+** returns 1 when the word is a pointer
+*/
+static int
+pointerref(struct ptrscan *ps, int from, long long val, int root)
+{
+	struct arange	*t;
+	struct block	*b;
+
+	if ( (t = findarea(mapar, nmapar, val)) == NULL)
+		return 0;
+
+	ps->in[t - mapar]++;
+	ps->edge[from][areaclass(t)]++;
+
+	if ( (b = findblock(val)) == NULL || !b->used)
+		return 1;
+
+	b->refs++;
+
+	if (root && !b->reach) {
+		b->reach = 1;
+		ps->work[ps->nwork++] = b - blocks;
+	}
+
+	return 1;
+}
+
+/*
+** check the aligned words of a chunk of data for pointers; in a heap
+** only the words in the user data of blocks in use are considered
+** (the prev_size field of the next chunk belongs to the user data)
+*/
+static void
+ptrchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	struct ptrscan	*ps = arg;
+	struct arange	*s = findarea(mapar, nmapar, (long long)a->start);
+	struct block	*b;
+	long long	val, w;
+	unsigned long long lo, hi;		// [vsyscall] is above 2^63
+	int		from = areaclass(a), heap = heaparea(a);
+	long		i;
+
+	lo = (unsigned long long)mapar[0].start;
+	hi = (unsigned long long)mapar[nmapar-1].start + mapar[nmapar-1].length;
+
+	for (i = (8 - addr % 8) % 8; i + 8 <= len; i += 8) {
+		ps->words++;
+
+		memcpy(&val, buf + i, 8);
+
+		if ((unsigned long long)val < lo ||
+		    (unsigned long long)val >= hi)
+			continue;
+
+		if (heap) {
+			w = addr + i;
+
+			if ( (b = findblock(w)) == NULL)
+				continue;
+
+			if (w - b->addr < CHUNKHDR) {
+				if (w != b->addr || b == blocks || !b[-1].used ||
+				    b[-1].addr + b[-1].size != b->addr)
+					continue;
+				b--;
+			}
+
+			if (!b->used)
+				continue;
+		}
+
+		if (pointerref(ps, from, val, !heap) && s)
+			ps->out[s - mapar]++;
+	}
+}
+
+static void
+ptrhole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+}
+
+/*
+** scan the user data of the reachable blocks on the work list and
+** mark the blocks they point to as reachable
+*/
+static void
+reachblocks(struct ptrscan *ps, struct arange ar[], int nar)
+{
+	struct arange	*a;
+	struct block	*b, *t;
+	long long	addr, end, val;
+	long		n, i;
+
+	while (ps->nwork) {
+		b = &blocks[ps->work[--ps->nwork]];
+
+		if ( (a = findarea(ar, nar, b->addr)) == NULL)
+			continue;
+
+		addr = b->addr + CHUNKHDR;
+		end  = b->addr + b->size + 8;
+
+		if (end > (long long)a->start + a->length)
+			end = (long long)a->start + a->length;
+
+		for (; addr < end; addr += n) {
+			n = end - addr > CHUNKSIZE ? CHUNKSIZE : end - addr;
+
+			if ( (n = memread(a, addr, chunkbuf, n)) == 0)
+				break;
+
+			for (i=0; i + 8 <= n; i += 8) {
+				memcpy(&val, chunkbuf + i, 8);
+
+				if ( (t = findblock(val)) && t->used && !t->reach) {
+					t->reach = 1;
+					ps->work[ps->nwork++] = t - blocks;
+				}
+			}
+		}
+	}
+}
+
+/*
+** order leak candidates by size (largest first)
+*/
+static int
+leakcmp(const void *a, const void *b)
+{
+	const struct block	*ba = &blocks[*(long *)a], *bb = &blocks[*(long *)b];
+
+	if (ba->size != bb->size)
+		return ba->size < bb->size ? 1 : -1;
+
+	return ba->addr < bb->addr ? -1 : 1;
 }
 
 /*
-** detach target process from current process
+** usable size of a block in use (like malloc_usable_size): a chunk
+** can also use the prev_size field of the next chunk, except when it
+** is mmapped on its own
+*/
+static long long
+usablesize(struct block *b)
+{
+	return b->size - (b->kind == BL_MMAP ? CHUNKHDR : CHUNKHDR / 2);
+}
+
+/*
+** pointer graph of a process: pointers per area and per class of
+** areas, and the heap blocks in use that can not be reached via
+** pointers from the registers, stacks and other areas (leak
+** candidates); the analysis is conservative: every aligned word
+** with the value of an address counts as pointer
 */
 static void
-detachproc(int pid)
+ptrreport(struct arange ar[], int nar)
 {
-        (void) ptrace(PTRACE_CONT,   pid, NULL, NULL);
-        (void) ptrace(PTRACE_DETACH, pid, NULL, NULL);
+	struct ptrscan	ps;
+	struct block	*b;
+	struct arange	*a;
+	long long	used = 0, uskib = 0, nfree = 0, frkib = 0;
+	long long	nreach = 0, nleak = 0, lkkib = 0, nunref = 0, val;
+	long		*leak, n;
+	int		i, j, t;
+
+	memset(&ps, 0, sizeof ps);
+
+	loadareas(pid);
+
+	if (nmapar == 0)
+		return;
+
+	// blocks of all heaps
+	//
+	heapscan(ar, nar);
+
+	if ( (ps.in   = calloc(nmapar, sizeof *ps.in))   == NULL ||
+	     (ps.out  = calloc(nmapar, sizeof *ps.out))  == NULL ||
+	     (ps.work = malloc((nblocks + 1) * sizeof *ps.work)) == NULL) {
+		perror("Can't allocate pointer counters");
+		detachproc(pid);
+		exit(1);
+	}
+
+	// registers of the stopped threads are roots
+	//
+	for (t=0; t < ntasks; t++) {
+		if (!tasks[t].hasregs)
+			continue;
+
+		for (j=0; j < sizeof tasks[t].regs / 8; j++) {
+			memcpy(&val, (char *)&tasks[t].regs + j * 8, 8);
+			pointerref(&ps, CL_REGS, val, 1);
+		}
+	}
+
+	// all writable areas
+	//
+	for (i=0; i < nar; i++)
+		if (ar[i].perm[1] == 'w')
+			walkarea(&ar[i], ptrchunk, ptrhole, &ps, 1);
+
+	reachblocks(&ps, ar, nar);
+
+	// pointers per area
+	//
+	outprintf("START         PERMS   POINTERS  REFERENCED  NAME\n");
+
+	for (i=0; i < nmapar; i++) {
+		a = &mapar[i];
+
+		if ((ps.in[i] == 0 && ps.out[i] == 0) || !selectarea(a))
+			continue;
+
+		outprintf("%012llx  %-5s %10lld  %10lld  %s\n",
+			(long long)a->start, a->perm, ps.out[i], ps.in[i],
+			a->name);
+	}
+
+	// pointers per class of source and target area
+	//
+	outprintf("\n%lld words scanned\n\nFROM \\ TO ", ps.words);
+
+	for (j=0; j < CL_REGS; j++)
+		outprintf("%11s", clname[j]);
+
+	outprintf("\n");
+
+	for (i=0; i < NCLASS; i++) {
+		outprintf("%-10s", clname[i]);
+
+		for (j=0; j < CL_REGS; j++)
+			outprintf("%11lld", ps.edge[i][j]);
+
+		outprintf("\n");
+	}
+
+	// heap blocks and leak candidates
+	//
+	if ( (leak = malloc((nblocks + 1) * sizeof *leak)) == NULL) {
+		perror("Can't allocate leak candidates");
+		detachproc(pid);
+		exit(1);
+	}
+
+	for (n=0, b=blocks; b < blocks + nblocks; b++) {
+		if ( (a = findarea(mapar, nmapar, b->addr)) && !selectarea(a))
+			continue;
+
+		if (!b->used) {
+			nfree++;
+			frkib += b->size;
+			continue;
+		}
+
+		used++;
+		uskib += b->size;
+
+		if (b->reach) {
+			nreach++;
+			continue;
+		}
+
+		nleak++;
+		lkkib += b->size;
+
+		if (b->refs == 0)
+			nunref++;
+
+		leak[n++] = b - blocks;
+	}
+
+	outprintf("\nheap blocks: %lld in use (%lld KiB), %lld free (%lld KiB)\n",
+		used, uskib / 1024, nfree, frkib / 1024);
+
+	outprintf("reachable %lld, not reachable %lld (%lld KiB) of which "
+		  "%lld unreferenced\n", nreach, nleak, lkkib / 1024, nunref);
+
+	if (n)
+		outprintf("\nleak candidates (REFS: pointers from blocks that "
+			  "are not reachable)\nADDRESS            SIZE   REFS\n");
+
+	qsort(leak, n, sizeof *leak, leakcmp);
+
+	for (i=0; i < n; i++) {
+		b = &blocks[leak[i]];
+
+		outprintf("%012llx  %9lld  %5ld\n", b->addr + CHUNKHDR,
+				usablesize(b), b->refs);
+
+		a = findarea(ar, nar, b->addr);
+
+		if (a && (val = memread(a, b->addr + CHUNKHDR, chunkbuf,
+		    b->size - CHUNKHDR < BYTESPERLINE ?
+				b->size - CHUNKHDR : BYTESPERLINE)) > 0)
+			dumpline(b->addr + CHUNKHDR, chunkbuf, val);
+	}
+
+	free(leak);
+	free(ps.in);
+	free(ps.out);
+	free(ps.work);
+}
+
+/*
+** content classification (--classify): every resident page gets a
+** class and its Shannon entropy (bits per byte); the compressed size
+** of a page is estimated from its entropy (order-0), pages with
+** zeroes or a repeating pattern are assumed to compress completely
+*/
+#define	PC_ZERO		0
+#define	PC_TEXT		1	// printable characters (and zero bytes)
+#define	PC_POINTER	2	// many aligned words point into areas
+#define	PC_RANDOM	3	// compressed or encrypted
+#define	PC_REPEAT	4	// short repeating pattern
+#define	PC_BINARY	5	// other
+#define	PC_ABSENT	6	// not resident, swapped or not readable
+#define	NPCLASS		7
+
+char	pcmap[]    = "0tpr=b.";
+char	*pcname[]  = { "ZERO", "TEXT", "POINTER", "RANDOM", "REPEAT",
+		       "BINARY" };
+
+#define	TEXTSHARE	0.90	// printable or zero bytes, and
+#define	TEXTMIN		0.50	// printable bytes
+#define	PTRSHARE	0.25	// words that point into an area
+#define	RANDOMBITS	7.2	// entropy (bits per byte)
+#define	MAXPERIOD	64	// longest repeating pattern
+#define	MAPPAGES	64	// pages per line of the map
+
+double	*clog2;			// c * log2(c) for counts up to pagesize
+char	istext[256];
+
+struct classarea {
+	long long	base;	// address of first page
+	unsigned char	*cls;	// class per page
+	unsigned char	*ent;	// entropy per page (1/16 bits per byte)
+};
+
+/*
+** classify one (possibly partial) page
+*/
+static void
+classpage(struct classarea *ca, long long addr, unsigned char *p, long n)
+{
+	long		cnt[256], i, text = 0, zero, words = 0, ptrs = 0;
+	long long	val;
+	double		h;
+	int		c, per;
+
+	memset(cnt, 0, sizeof cnt);
+
+	for (i=0; i < n; i++)
+		cnt[p[i]]++;
+
+	// entropy: log2(n) - sum(c * log2(c)) / n
+	//
+	for (h = 0, c=0; c < 256; c++)
+		h += clog2[cnt[c]];
+
+	h = n > 1 ? log2(n) - h / n : 0;
+
+	i = (addr - ca->base) / pagesize;
+	ca->ent[i] = h * 16 + 0.5 > 128 ? 128 : h * 16 + 0.5;
+
+	for (c=0; c < 256; c++)
+		if (istext[c])
+			text += cnt[c];
+
+	zero = cnt[0];
+
+	if (zero == n) {
+		ca->cls[i] = PC_ZERO;
+		return;
+	}
+
+	// repeating pattern of at most MAXPERIOD bytes
+	//
+	for (per=1; per <= MAXPERIOD && per < n; per++) {
+		if (memcmp(p, p + per, n - per) == 0) {
+			ca->cls[i] = PC_REPEAT;
+			return;
+		}
+	}
+
+	if (text >= n * TEXTMIN && text + zero >= n * TEXTSHARE) {
+		ca->cls[i] = PC_TEXT;
+		return;
+	}
+
+	if (h >= RANDOMBITS) {
+		ca->cls[i] = PC_RANDOM;
+		return;
+	}
+
+	for (c = (8 - addr % 8) % 8; c + 8 <= n; c += 8, words++) {
+		memcpy(&val, p + c, 8);
+
+		if (val && findarea(mapar, nmapar, val))
+			ptrs++;
+	}
+
+	ca->cls[i] = words && ptrs >= words * PTRSHARE ? PC_POINTER : PC_BINARY;
+}
+
+/*
+** classify the pages of a chunk of data (called by several threads
+** for different pages with --jobs)
+*/
+static void
+classchunk(struct arange *a, long long addr, unsigned char *buf, long len,
+								void *arg)
+{
+	long	off, next;
+
+	for (off = 0; off < len; off = next) {
+		next = off + pagesize - (addr + off) % pagesize;
+
+		if (next > len)
+			next = len;
+
+		classpage(arg, addr + off, buf + off, next - off);
+	}
+}
+
+static void
+classhole(struct arange *a, long long addr, long long len, int kind,
+								void *arg)
+{
+	struct classarea	*ca = arg;
+	long long		i, end = addr + len;
+
+	for (i = (addr - ca->base) / pagesize;
+	     ca->base + i * pagesize < end; i++) {
+		ca->cls[i] = kind == PG_ZERO ? PC_ZERO : PC_ABSENT;
+		ca->ent[i] = 0;
+	}
+}
+
+/*
+** classify the pages of all areas and show per area the number of
+** pages per class, the mean entropy and the estimated compressed
+** size, or a map with one character per page
+*/
+static void
+classify(struct arange ar[], int nar, int map)
+{
+	struct classarea	ca;
+	long long		tot[NPCLASS], cnt[NPCLASS], npages, i, j;
+	long long		est, totest = 0, entsum, totent = 0;
+	long long		nres, totres = 0;
+	int			n, c;
+
+	if ( (clog2 = malloc((pagesize + 1) * sizeof *clog2)) == NULL) {
+		perror("Can't allocate entropy table");
+		detachproc(pid);
+		exit(1);
+	}
+
+	for (clog2[0] = 0, i=1; i <= pagesize; i++)
+		clog2[i] = i * log2(i);
+
+	for (c=0; c < 256; c++)
+		istext[c] = isprint(c) || c == '\t' || c == '\n' || c == '\r';
+
+	loadareas(pid);			// pointer targets
+
+	memset(tot, 0, sizeof tot);
+
+	if (map)
+		outprintf("map: 0 zero  t text  p pointers  r random  "
+			  "= repeating  b binary  . not resident\n");
+	else
+		outprintf("START         PERMS      ZERO      TEXT   POINTER"
+			  "    RANDOM    REPEAT    BINARY    ABSENT  ENTROPY"
+			  "  COMPRKiB  NAME\n");
+
+	for (n=0; n < nar; n++) {
+		ca.base = (long long)ar[n].start & ~(pagesize - 1);
+		npages  = ((long long)ar[n].start + ar[n].length - ca.base +
+						pagesize - 1) / pagesize;
+
+		if ( (ca.cls = malloc(npages)) == NULL ||
+		     (ca.ent = malloc(npages)) == NULL) {
+			perror("Can't allocate page classes");
+			detachproc(pid);
+			exit(1);
+		}
+
+		parwalk(&ar[n], classchunk, classhole, &ca, 1, 0);
+
+		memset(cnt, 0, sizeof cnt);
+
+		for (i=est=entsum=0; i < npages; i++) {
+			cnt[ca.cls[i]]++;
+			entsum += ca.ent[i];
+
+			if (ca.cls[i] != PC_ZERO && ca.cls[i] != PC_REPEAT)
+				est += ca.ent[i] * pagesize / 128;
+		}
+
+		nres = npages - cnt[PC_ABSENT];
+
+		if (map) {
+			outprintf("------------  perms=%s  vsize=%lldKiB  %s\n",
+				ar[n].perm, ar[n].length/1024, ar[n].name);
+
+			for (i=0; i < npages; i += MAPPAGES) {
+				outprintf("%012llx  ", ca.base + i * pagesize);
+
+				for (j=i; j < npages && j < i + MAPPAGES; j++)
+					outprintf("%c", pcmap[ca.cls[j]]);
+
+				outprintf("\n");
+			}
+		} else {
+			outprintf("%012llx  %-5s", (long long)ar[n].start,
+							ar[n].perm);
+
+			for (c=0; c < NPCLASS; c++)
+				outprintf(" %9lld", cnt[c]);
+
+			outprintf(" %8.2f %9lld  %s\n",
+				nres ? entsum / 16.0 / nres : 0.0, est / 1024,
+				ar[n].name);
+		}
+
+		for (c=0; c < NPCLASS; c++)
+			tot[c] += cnt[c];
+
+		totres += nres;
+		totent += entsum;
+		totest += est;
+
+		free(ca.cls);
+		free(ca.ent);
+	}
+
+	// totals (in KiB)
+	//
+	outprintf("\n");
+
+	for (c=0; c < PC_ABSENT; c++)
+		outprintf("%s %lld KiB  ", pcname[c], tot[c] * pagesize / 1024);
+
+	outprintf("\nresident %lld KiB, mean entropy %.2f bits/byte, "
+		  "estimated compressed %lld KiB (ratio %.1f)\n",
+		  totres * pagesize / 1024,
+		  totres ? totent / 16.0 / totres : 0.0, totest / 1024,
+		  totest ? (double)totres * pagesize / totest : 0.0);
+
+	free(clog2);
+}
+
+/*
+** show the areas with their properties from smaps and the totals
+*/
+static void
+summary(struct arange ar[], int nar)
+{
+	long long	vsize = 0, rss = 0, pss = 0, swap = 0, anonhuge = 0;
+	int		i;
+
+	outprintf("START         END           PERMS     VSIZE       RSS       PSS"
+	          "      SWAP  ANONHUGE  VMFLAGS                          NAME\n");
+
+	for (i=0; i < nar; i++) {
+		outprintf("%012llx  %012llx  %-5s %9lld %9lld %9lld %9lld %9lld"
+			  "  %-32s %s\n",
+			(long long)ar[i].start,
+			(long long)ar[i].start + ar[i].length, ar[i].perm,
+			ar[i].length / 1024, ar[i].rss, ar[i].pss, ar[i].swap,
+			ar[i].anonhuge, ar[i].vmflags, ar[i].name);
+
+		vsize    += ar[i].length / 1024;
+		rss      += ar[i].rss;
+		pss      += ar[i].pss;
+		swap     += ar[i].swap;
+		anonhuge += ar[i].anonhuge;
+	}
+
+	outprintf("%d areas                          %9lld %9lld %9lld %9lld %9lld"
+		  "  (KiB)\n", nar, vsize, rss, pss, swap, anonhuge);
 }
 
+/*
+** get the virtual memory areas in process' address space that are
+** selected (--only, --perm, no special areas)
+** returns the number of areas or -1
+*/
+static int
+getaddranges(long pid, struct arange **arp, int *maxp)
+{
+	int	nar;
+
+	if ( (nar = readareas(pid, arp, maxp)) == -1)
+		return -1;
+
+	return selectareas(*arp, nar, 0);
+}
 
 /*
-** get start address and length of every virtual memory area
-** in process' address space
+** get every virtual memory area in process' address space with its
+** properties from smaps; the table of areas (with *maxp entries
+** allocated) is extended when needed
+** returns the number of areas or -1
 */
 static int
-getaddranges(long pid, struct arange ar[], int maxar)
+readareas(long pid, struct arange **arp, int *maxp)
 {
-	FILE	*fp;
-   	char	path[128], line[256];
-	int	i = 0;
-	void	*end;
+	FILE		*fp;
+	char		path[128], *line = NULL;
+	size_t		size = 0;
+	int		i = 0, n;
+	long long	start, end, val;
+	struct arange	*a = NULL;
 
-	snprintf(path, sizeof path, "/proc/%d/smaps", pid);
+	snprintf(path, sizeof path, "/proc/%ld/smaps", pid);
 
 	if ( (fp = fopen(path, "r")) == NULL) {
 		perror("Open smaps");
 		return -1;
 	}
 
-	while ( fgets(line, sizeof line, fp) )
+	while ( getline(&line, &size, fp) != -1 )
 	{
-		if (i >= maxar)
-			break;
+		line[strcspn(line, "\n")] = '\0';
 
-		if ( sscanf(line, "%p-%p", &(ar[i].start), &end) < 2)
-			continue;
+		// first line of an area: start-end perms offset dev inode name
+		//
+		if ( sscanf(line, "%llx-%llx %15s %llx %*s %*s %n", &start, &end,
+						path, &val, &n) == 4) {
+			if (i == *maxp) {
+				*maxp = *maxp ? *maxp * 2 : 256;
 
-		ar[i].name[0] = 0;
-		sscanf(line, "%*s %15s %*s %*s %*s %127s",
-					ar[i].perm, ar[i].name);
+				if ( (*arp = realloc(*arp,
+						*maxp * sizeof **arp)) == NULL) {
+					perror("Can't allocate areas");
+					exit(1);
+				}
 
-		ar[i].length = end - ar[i].start;
+				memset(*arp + i, 0, (*maxp - i) * sizeof **arp);
+			}
+
+			a = *arp + i++;
+
+			free(a->name);
+			memset(a, 0, sizeof *a);
+
+			a->start  = (void *)start;
+			a->length = end - start;
+			a->offset = val;
+			a->name   = strdup(line + n);
+			strcpy(a->perm, path);
+			continue;
+		}
+
+		if (!a)
+			continue;
 
-		i++;
-	} 
+		// properties of the current area
+		//
+		if (sscanf(line, "Rss: %lld", &val) == 1)
+			a->rss = val;
+		else if (sscanf(line, "Pss: %lld", &val) == 1)
+			a->pss = val;
+		else if (sscanf(line, "Swap: %lld", &val) == 1)
+			a->swap = val;
+		else if (sscanf(line, "AnonHugePages: %lld", &val) == 1)
+			a->anonhuge = val;
+		else if (strncmp(line, "VmFlags:", 8) == 0)
+			snprintf(a->vmflags, sizeof a->vmflags, "%s",
+						line + 8 + strspn(line + 8, " "));
+	}
 
+	free(line);
 	fclose(fp);
 
 	return i;
 }
+
+/*
+** check if an area matches one of the types in the --only list
+*/
+static int
+matchtype(struct arange *a, int *explicit)
+{
+	char	list[1024], *t, *save;
+	int	match = 0;
+
+	snprintf(list, sizeof list, "%s", onlytypes);
+
+	for (t = strtok_r(list, ",", &save); t && !match;
+					t = strtok_r(NULL, ",", &save)) {
+		if (strcmp(t, "heap") == 0)
+			match = strcmp(a->name, "[heap]") == 0;
+		else if (strcmp(t, "stack") == 0)
+			match = strncmp(a->name, "[stack", 6) == 0;
+		else if (strcmp(t, "anon") == 0)
+			match = a->name[0] == '\0' ||
+				strncmp(a->name, "[anon", 5) == 0;
+		else if (strcmp(t, "file") == 0)
+			match = a->name[0] == '/';
+		else
+			match = *explicit = strstr(a->name, t) != NULL ||
+				(strpbrk(t, "*?[") && fnmatch(t, a->name, 0) == 0);
+	}
+
+	return match;
+}
+
+/*
+** check if an area is special: kernel-provided pages that can not be
+** read or device memory (VmFlags io or pf)
+*/
+static int
+specialarea(struct arange *a)
+{
+	char	flags[sizeof a->vmflags + 2];
+
+	if (strncmp(a->name, "[vvar", 5) == 0 ||
+	    strcmp(a->name, "[vsyscall]") == 0)
+		return 1;
+
+	snprintf(flags, sizeof flags, " %s ", a->vmflags);
+
+	return strstr(flags, " io ") || strstr(flags, " pf ");
+}
+
+/*
+** check if an area is selected by --only and --perm (special areas
+** only when a pattern matches them explicitly)
+*/
+static int
+selectarea(struct arange *a)
+{
+	char	*p;
+	int	explicit = 0, ok;
+
+	ok = onlytypes ? matchtype(a, &explicit) : 1;
+
+	if (ok && specialarea(a) && !explicit)
+		ok = 0;
+
+	for (p = onlyperms; ok && p && *p; p++) {
+		switch (*p) {
+		   case 'r':
+		   case 'w':
+		   case 'x':
+			ok = strchr(a->perm, *p) != NULL;
+			break;
+		   default:		// p(rivate) or s(hared)
+			ok = a->perm[3] == *p;
+		}
+	}
+
+	return ok;
+}
+
+/*
+** remove the areas that are not selected by --only and --perm, and the
+** special areas, from the table of areas; with all set only the special
+** areas are removed
+** returns the remaining number of areas
+*/
+static int
+selectareas(struct arange ar[], int nar, int all)
+{
+	struct arange	keep;
+	int		i, n;
+
+	for (i=n=0; i < nar; i++) {
+		if (!selectarea(&ar[i]) && (!all || specialarea(&ar[i])))
+			continue;
+
+		// swap to keep the name of the dropped area allocated
+		//
+		keep  = ar[n];
+		ar[n] = ar[i];
+		ar[i] = keep;
+		n++;
+	}
+
+	return n;
+}
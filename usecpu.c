@@ -2,140 +2,2018 @@
 **
 ** Force a well-defined pattern of CPU utilization.
 **
-** Usage: usecpu [C] [P%]
+** Usage: usecpu [--threads N] [C] [P%]
+**          N - number of load threads (default: 1)
 **          C - number of CPU seconds to consume in total (default: infinite)
-**          P - percentage of forced consumption (default: 100%)
+**          P - percentage of forced consumption per thread (default: 100%)
+**
+**        The total CPU consumption of all threads is taken from the
+**        process CPU clock. When it reaches C seconds, or when usecpu
+**        is interrupted by SIGINT or SIGTERM, all threads are stopped
+**        and the consumed CPU time is compared to the requested time.
 **
 ** Example:	usecpu 30 25%
 **
 **		Forces 25% of CPU utilization until 30 seconds of CPU time
 **		is consumed (i.e. lasting two minutes of wall clock time).
 **
+**        usecpu --interval S ...
+**
+**		Every S seconds report the CPU utilization of usecpu, the
+**		mean clock frequency and the C-state residency of the CPUs
+**		that usecpu ran on during that interval (as far as cpufreq
+**		and cpuidle are available in sysfs). Can be combined with
+**		the default load and the arrival-driven load.
+**
+**        usecpu --kernel K ...
+**
+**		Consume the CPU time with load kernel K (int, fp, avx or
+**		mem) instead of an empty loop. The memory kernel can be
+**		tuned as mem:SIZE[,rand|seq|stride:N][,miss:P] where SIZE
+**		is the working set (e.g. 16K is L1-resident, 1G is DRAM
+**		bound), the pattern defines the order in which the cache
+**		lines are visited (default: rand) and P is the percentage
+**		of accesses that go to the working set instead of to a
+**		small L1-resident area (default: 100). When hardware
+**		counters are available, the measured L1D and LLC misses
+**		per access are reported as verification.
+**
+**        usecpu --smt[=kernel,...] [--smt-msec M]
+**
+**		Measure the interference between two threads running on
+**		SMT siblings of one physical core, compared to two threads
+**		running on separate physical cores. Every combination of the
+**		specified kernels (int, fp, avx, mem; default: all) is run
+**		for M milliseconds (default: 1000) and reported as a matrix
+**		of slowdown factors relative to the measured kernel running
+**		alone.
+**
+**        usecpu --arrivals rate:R[,burst:B] --service mean:U[,dist]
+**               [--threads N] [C]
+**
+**		Generate CPU demand as discrete jobs that arrive at random
+**		moments (Poisson process with R jobs per second, optionally
+**		in bursts of on average B jobs) and are executed by a pool
+**		of N threads (default: number of CPUs). Every job consumes
+**		on average U microseconds of CPU time, distributed as
+**		fixed (default), exp or uniform. When C CPU seconds have
+**		been consumed by the jobs (or when interrupted), the
+**		percentiles of queueing delay and response time are shown.
+**
 ** ==========================================================================
 ** Author:       Gerlof Langeveld
 ** Copyright (C) 2008  AT Computing
 ** Modified:     2020  AT Computing - added percentage
+** Modified:     2026  AT Computing - added SMT interference measurement
+**                                   added arrival-driven load
+**                                   added cpufreq/C-state reporting
+**                                   added selectable load kernels
+**                                   added multiple threads and exact
+**                                   CPU budget
 ** ==========================================================================
 ** This file is free software.  You can redistribute it and/or modify
 ** it under the terms of the GNU General Public License (GPL); either
 ** version 3, or (at your option) any later version.
 */
 
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/param.h>
-#include <sys/time.h>
 #include <signal.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <errno.h>
+#include <math.h>
+#include <ctype.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #define	EVER		;;
 
-unsigned long long	totalcpusec=9999999999, cpuperc=100, cpumsec;
+#define	MAXKERN		4		// number of load kernels
+#define	KBATCH		1000		// kernel iterations between stop checks
+#define	MEMCHAIN	(64*1024*1024)	// default working set of mem kernel
+#define	MEMSMALL	4096		// L1-resident area of mem kernel
+#define	LINESIZE	64		// bytes per cache line
+#define	LINEWORDS	(LINESIZE/sizeof(unsigned long))
+#define	SMTWARMUP	100		// msec aggressor runs before measuring
+
+#define	KCALIBRATE	1000000		// nsec CPU time to calibrate batch
+#define	KBATCHNSEC	100000		// nsec CPU time of one batch
+#define	PERIOD		1000000000	// nsec wall time of one duty cycle
+
+#define	MAXQUEUE	65536		// max number of jobs waiting
+#define	SVCBATCH	200		// kernel iterations between CPU checks
+#define	HSUBBITS	5		// histogram: 32 buckets per power of 2
+#define	HBUCKETS	(60<<HSUBBITS)
+
+#define	MAXCPU		1024		// max number of CPUs reported
+#define	MAXCSTATE	16		// max number of C-states per CPU
+#define	FREQSAMPLES	10		// frequency samples per interval
+
+/*
+** load kernels: every kernel executes a number of iterations of a
+** specific kind of work and returns a value that depends on all
+** iterations (to prevent that the compiler optimizes the work away)
+*/
+struct kstate {
+	unsigned long long	ival;		// int: shift register
+	double			fval[4];	// fp:  independent chains
+	unsigned long		*chain;		// mem: pointer chain
+	unsigned long		*small;		// mem: L1-resident chain
+	unsigned long		pos, spos;	// mem: current chain indexes
+	unsigned int		acc;		// mem: miss accumulator
+};
+
+/*
+** parameters of the memory kernel: the working set is a chain of
+** cache lines visited in a specific order
+*/
+#define	MEMRAND		0		// random order (dependent misses)
+#define	MEMSEQ		1		// sequential (prefetch friendly)
+#define	MEMSTRIDE	2		// fixed stride
+
+struct memparam {
+	unsigned long long	size;		// working set in bytes
+	int			pattern;
+	unsigned long		stride;		// bytes for MEMSTRIDE
+	unsigned int		missperc;	// accesses to working set
+} memparam = { MEMCHAIN, MEMRAND, 0, 100 };
+
+struct kernel {
+	char			*name;
+	unsigned long long	(*func)(struct kstate *, unsigned long);
+};
+
+static unsigned long long	kern_int(struct kstate *, unsigned long);
+static unsigned long long	kern_fp (struct kstate *, unsigned long);
+static unsigned long long	kern_avx(struct kstate *, unsigned long);
+static unsigned long long	kern_mem(struct kstate *, unsigned long);
+
+struct kernel	kernels[MAXKERN] = {
+	{ "int",	kern_int },
+	{ "fp",		kern_fp  },
+	{ "avx",	kern_avx },
+	{ "mem",	kern_mem },
+};
+
+/*
+** one thread running a load kernel on a specific CPU during an
+** SMT interference measurement
+*/
+struct smtthread {
+	pthread_t		tid;
+	int			cpu;
+	struct kernel		*kern;
+	struct kstate		state;
+	unsigned long long	iters;		// iterations executed
+	double			secs;		// elapsed time of execution
+};
+
+volatile int	smtstop;
+
+/*
+** arrival-driven load: jobs with their arrival time and CPU demand
+** (nanoseconds) are queued by the generator and executed by a pool
+** of worker threads; every worker keeps its own latency histograms
+*/
+struct job {
+	unsigned long long	arrival;	// CLOCK_MONOTONIC
+	unsigned long long	demand;		// CPU time
+};
+
+struct histo {
+	unsigned long long	count, sum, max;
+	unsigned long long	bucket[HBUCKETS];
+};
+
+struct worker {
+	pthread_t		tid;
+	struct kstate		state;
+	struct histo		qdelay, resp;
+};
+
+struct jobqueue {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct job		jobs[MAXQUEUE];
+	unsigned long		head, tail;	// tail-head is queue length
+	volatile int		stop;
+} jq = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+unsigned long long	jobsdone, jobsdropped, jobsaborted, jobcpunsec;
+
+/*
+** load threads of the default duty-cycle load
+*/
+struct loadthread {
+	pthread_t		tid;
+	struct kstate		state;
+};
+
+/*
+** CPU budget shared by all threads: the thread that notices that the
+** process CPU clock passed the budget signals the main thread, which
+** stops all threads (also on SIGINT and SIGTERM)
+*/
+unsigned long long	budgetnsec;		// 0 is infinite
+pthread_t		mainthread;
+volatile sig_atomic_t	interrupted;		// signal that stopped load
+volatile int		loadstop;
+pthread_mutex_t		stoplock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t		stopcond;
+
+/*
+** interval reporting: counters per CPU as sampled from sysfs and the
+** set of CPUs that the load ran on during the current interval
+*/
+struct cpustat {
+	unsigned long long	freqsum;		// kHz
+	int			freqcnt;
+	int			nstates;
+	unsigned long long	usage[MAXCSTATE];	// C-state entries
+	unsigned long long	time[MAXCSTATE];	// C-state usec
+};
+
+unsigned long long	cpuseen[MAXCPU/64];
+
+/*
+** hardware counters to verify the cache behaviour of the load kernel
+*/
+#define	PERF_L1DMISS	0
+#define	PERF_LLCMISS	1
+#define	PERF_NUM	2
+
+int			perffd[PERF_NUM] = {-1, -1};
+unsigned long long	kiters;			// kernel iterations executed
+struct kernel		*loadkern;		// kernel for default load
+char			cstatename[MAXCSTATE][16];
+
+static void	usage(void);
+static int	cpuinlist(int, char *);
+static void	smtfactor(double, double);
+static void	histshow(char *, struct histo *);
+static void	markcpu(void);
+static void	budgetcheck(void);
+static void	perfshow(char *, unsigned long long [], unsigned long long);
+static struct kernel		*kernfind(char *);
+static unsigned long long	getsize(char *);
+static unsigned long long	nsecs(clockid_t);
+static void			kernsummary(void);
+
+unsigned long long	totalcpusec=0, cpuperc=100;
+
+/*
+** show command usage and terminate
+*/
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: usecpu [--interval sec] [--threads N] "
+	                "[cpusec] [cpuperc%]\n");
+	fprintf(stderr, "     N        - number of load threads "
+	                "(default: 1)\n");
+	fprintf(stderr, "     cpusec   - number of CPU seconds "
+	                "to consume in total "
+	                "(default: infinite)\n");
+	fprintf(stderr, "     cpuperc%% - percentage of CPU "
+	                "utilization per thread (default: 100%, "
+			"max 100%)\n");
+	fprintf(stderr, "   or: usecpu --smt[=kernel,...] [--smt-msec msec]\n");
+	fprintf(stderr, "     kernel   - int, fp, avx or mem "
+	                "(default: all)\n");
+	fprintf(stderr, "     msec     - duration of every measurement "
+	                "(default: 1000)\n");
+	fprintf(stderr, "   or: usecpu --arrivals rate:R[,burst:B] "
+	                "--service mean:U[,dist] [--threads N] [cpusec]\n");
+	fprintf(stderr, "     R        - mean number of job arrivals "
+	                "per second\n");
+	fprintf(stderr, "     B        - mean number of jobs per burst "
+	                "(default: 1)\n");
+	fprintf(stderr, "     U        - mean CPU time per job in "
+	                "microseconds\n");
+	fprintf(stderr, "     dist     - fixed, exp or uniform "
+	                "(default: fixed)\n");
+	fprintf(stderr, "     N        - number of worker threads "
+	                "(default: number of CPUs)\n");
+	fprintf(stderr, "   --interval sec: report utilization, frequency "
+	                "and C-states every sec seconds\n");
+	fprintf(stderr, "   --kernel K: consume CPU with kernel int, fp, avx "
+	                "or mem[:size][,rand|seq|stride:N][,miss:P]\n");
+	exit(1);
+}
+
+/*
+** integer kernel: xorshift and multiply in the integer ALUs
+*/
+static unsigned long long
+kern_int(struct kstate *ks, unsigned long n)
+{
+	unsigned long long	a = ks->ival, b = a ^ 0x9e3779b97f4a7c15ULL;
+
+	while (n--) {
+		a ^= a << 13;
+		a ^= a >> 7;
+		a ^= a << 17;
+		b += a * 0x2545f4914f6cdd1dULL;
+	}
+
+	ks->ival = a ^ b;
+
+	return ks->ival;
+}
+
+/*
+** floating point kernel: four independent multiply-add chains
+** in the scalar floating point unit
+*/
+static unsigned long long
+kern_fp(struct kstate *ks, unsigned long n)
+{
+	double	a = ks->fval[0], b = ks->fval[1],
+		c = ks->fval[2], d = ks->fval[3];
+
+	while (n--) {
+		a = a * 0.999999 + 0.000001;
+		b = b * 0.999998 + 0.000002;
+		c = c * 0.999997 + 0.000003;
+		d = d * 0.999996 + 0.000004;
+	}
+
+	ks->fval[0] = a; ks->fval[1] = b; ks->fval[2] = c; ks->fval[3] = d;
+
+	return (unsigned long long)(a + b + c + d);
+}
+
+/*
+** vector kernel: four independent multiply-add chains of 256-bit
+** vectors (on x86_64 an AVX2 version is selected at runtime when
+** the CPU supports it, otherwise generic vector code is used)
+*/
+typedef double	v4d __attribute__((vector_size(32)));
+
+#if defined(__x86_64__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+static unsigned long long
+kern_avx(struct kstate *ks, unsigned long n)
+{
+	v4d	a = {ks->fval[0], ks->fval[1], ks->fval[2], ks->fval[3]},
+		b = a + 1.0, c = a + 2.0, d = a + 3.0,
+		m = {0.999999, 0.999998, 0.999997, 0.999996},
+		o = {0.000001, 0.000002, 0.000003, 0.000004};
+
+	while (n--) {
+		a = a * m + o;
+		b = b * m + o;
+		c = c * m + o;
+		d = d * m + o;
+	}
+
+	a = a + b + c + d;
 
-struct timespec		curtime, pretime, sleeptime;
-struct itimerval	itv;
+	ks->fval[0] = a[0]; ks->fval[1] = a[1];
+	ks->fval[2] = a[2]; ks->fval[3] = a[3];
+
+	return (unsigned long long)(a[0] + a[1] + a[2] + a[3]);
+}
+
+/*
+** memory kernel: walk a randomly ordered pointer chain that is
+** much larger than the caches (every step is a dependent load)
+*/
+static unsigned long long
+kern_mem(struct kstate *ks, unsigned long n)
+{
+	unsigned long	*chain = ks->chain, *small = ks->small,
+			pos = ks->pos, spos = ks->spos;
+	unsigned int	acc = ks->acc, perc = memparam.missperc;
+
+	while (n--) {
+		if ( (acc += perc) >= 100) {
+			acc -= 100;
+			pos  = chain[pos];
+		} else {
+			spos = small[spos];
+		}
+	}
+
+	ks->pos  = pos;
+	ks->spos = spos;
+	ks->acc  = acc;
+
+	return pos + spos;
+}
 
 /*
-** signal handler for SIGVTARLM signal that is triggered
-** by CPU consumption
+** build a chain through the first word of n cache lines:
+** chain[line*LINEWORDS] contains the word index of the next line
 */
-void
-checkutil(int sig)
+static unsigned long *
+memchain(unsigned long n, int pattern, unsigned long stride)
 {
-	unsigned long long	mcur, mpre, mdif;
+	unsigned long	*chain, *order, i, j, k, tmp;
 
-	// oneshot number of CPU seconds defined?
-	if (cpuperc == 100)
-		exit(0);
+	if ( (chain = malloc(n * LINESIZE)) == NULL ||
+	     (order = malloc(n * sizeof *order)) == NULL) {
+		perror("Can't allocate pointer chain");
+		exit(1);
+	}
 
-	// keep track of real time to see if we have to sleep
-	// a while to fullfill the required CPU percentage
-	pretime = curtime;
-	clock_gettime(CLOCK_REALTIME, &curtime);
+	// determine the order in which the lines are visited
+	//
+	switch (pattern) {
+	   case MEMRAND:		// random permutation of all lines
+		for (i=0; i < n; i++)
+			order[i] = i;
 
-	mcur = (unsigned long long)curtime.tv_sec * 1000000 + 
-	                          (curtime.tv_nsec / 1000);
+		for (i=n-1; i > 0; i--) {
+			j = random() % (i+1);
+			tmp = order[i];
+			order[i] = order[j];
+			order[j] = tmp;
+		}
+		break;
 
-	mpre = (unsigned long long)pretime.tv_sec * 1000000 +
-	                          (pretime.tv_nsec / 1000);
+	   case MEMSEQ:
+		for (i=0; i < n; i++)
+			order[i] = i;
+		break;
 
-	mdif = mcur - mpre;
+	   case MEMSTRIDE:		// every stride, then shifted by one
+		stride = stride / LINESIZE ? stride / LINESIZE : 1;
 
-        if (mdif < 1000000) {
-		sleeptime.tv_nsec = (1000000 - mdif) * 1000;
-		nanosleep(&sleeptime, (struct timespec *)0);
+		for (i=k=0; i < stride; i++)
+			for (j=i; j < n; j+=stride)
+				order[k++] = j;
+		break;
 	}
 
-	// in case of explicit CPU percentage:
-	// - accumulate total CPU consumption so far
-	// - verify if we have exceeded total CPU consumption
-	cpumsec += 10000*cpuperc;
+	// link the lines into one cycle
+	//
+	for (i=0; i < n; i++)
+		chain[order[i] * LINEWORDS] = order[(i+1) % n] * LINEWORDS;
 
-	if (cpumsec >= totalcpusec * 1000000)
-		exit(0);
+	free(order);
 
-	clock_gettime(CLOCK_REALTIME, &curtime);
+	return chain;
 }
 
-int
-main(int argc, char *argv[])
+/*
+** parse the specification of a kernel, i.e. a name optionally
+** followed by parameters (only for the memory kernel)
+*/
+static struct kernel *
+kernparse(char *spec)
 {
-	int			i;
-	unsigned long		val;
+	struct kernel	*kp;
+	char		*p, *q, *copy = strdup(spec);
+
+	if ( (p = strchr(copy, ':')) )
+		*p++ = '\0';
+
+	if ( (kp = kernfind(copy)) == NULL) {
+		fprintf(stderr, "invalid kernel: %s "
+		                "(valid: int, fp, avx, mem)\n", copy);
+		exit(1);
+	}
+
+	if (p && kp->func != kern_mem) {
+		fprintf(stderr, "kernel %s has no parameters\n", copy);
+		exit(1);
+	}
+
+	for (p = p ? strtok(p, ",") : NULL; p; p = strtok(NULL, ",")) {
+		if (isdigit(*p)) {
+			memparam.size = getsize(p);
+		} else if (strcmp(p, "rand") == 0) {
+			memparam.pattern = MEMRAND;
+		} else if (strcmp(p, "seq") == 0) {
+			memparam.pattern = MEMSEQ;
+		} else if (strncmp(p, "stride:", 7) == 0) {
+			memparam.pattern = MEMSTRIDE;
+			memparam.stride  = getsize(p+7);
+		} else if (strncmp(p, "miss:", 5) == 0) {
+			memparam.missperc = strtol(p+5, &q, 10);
+
+			if ((*q && strcmp(q, "%")) || memparam.missperc > 100) {
+				fprintf(stderr, "invalid miss percentage: %s\n",
+									p+5);
+				exit(1);
+			}
+		} else {
+			fprintf(stderr, "invalid mem parameter: %s\n", p);
+			exit(1);
+		}
+	}
+
+	if (memparam.size < LINESIZE) {
+		fprintf(stderr, "working set must be at least %d bytes\n",
+								LINESIZE);
+		exit(1);
+	}
+
+	free(copy);
+
+	return kp;
+}
+
+/*
+** convert size with optional suffix [KMG] to number of bytes
+*/
+static unsigned long long
+getsize(char *s)
+{
+	unsigned long long	n;
 	char			*p;
 
-	// check all arguments
-	for (i=1; i < argc; i++) {
-		val = strtol(argv[i], &p, 10);
+	n = strtoull(s, &p, 10);
 
-		switch (*p) {
-		   case '\0':		// CPU seconds to use
-			totalcpusec = val;
-			break;
-		   case '%':		// CPU percentage to force
-			if (val <= 100) {
-				cpuperc = val;
+	switch (toupper(*p)) {
+	   case 'K':
+		n *= 1024;
+		p++;
+		break;
+	   case 'M':
+		n *= 1024*1024;
+		p++;
+		break;
+	   case 'G':
+		n *= 1024*1024*1024;
+		p++;
+		break;
+	}
+
+	if (*p || n == 0) {
+		fprintf(stderr, "invalid size: %s (use [KMG])\n", s);
+		exit(1);
+	}
+
+	return n;
+}
+
+/*
+** prepare the state of a kernel before it is executed
+*/
+static void
+kerninit(struct kernel *kp, struct kstate *ks)
+{
+	memset(ks, 0, sizeof *ks);
+
+	ks->ival = 0x123456789abcdefULL;
+	ks->fval[0] = 0.1; ks->fval[1] = 0.2;
+	ks->fval[2] = 0.3; ks->fval[3] = 0.4;
+
+	if (kp->func != kern_mem)
+		return;
+
+	// working set with the requested access pattern and a small
+	// random chain that stays in the L1 cache
+	//
+	ks->chain = memchain(memparam.size / LINESIZE, memparam.pattern,
+							memparam.stride);
+	ks->small = memchain(MEMSMALL / LINESIZE, MEMRAND, 0);
+}
+
+static void
+kernfree(struct kstate *ks)
+{
+	free(ks->chain);
+	free(ks->small);
+	ks->chain = ks->small = NULL;
+}
+
+/*
+** find a kernel by name
+*/
+static struct kernel *
+kernfind(char *name)
+{
+	int	i;
+
+	for (i=0; i < MAXKERN; i++)
+		if (strcmp(kernels[i].name, name) == 0)
+			return &kernels[i];
+
+	return NULL;
+}
+
+/*
+** read a CPU topology attribute from sysfs
+** returns -1 if not available
+*/
+static int
+cputopo(int cpu, char *attr, char *buf, int buflen)
+{
+	char	path[128];
+	FILE	*fp;
+
+	snprintf(path, sizeof path,
+		"/sys/devices/system/cpu/cpu%d/topology/%s", cpu, attr);
+
+	if ( (fp = fopen(path, "r")) == NULL)
+		return -1;
+
+	if ( fgets(buf, buflen, fp) == NULL) {
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return 0;
+}
+
+/*
+** determine a pair of SMT siblings (cpu, sibcpu) and a CPU on another
+** physical core in the same package (corecpu), all within the affinity
+** mask of this process
+** sibcpu and corecpu are -1 when not available
+*/
+static int
+smtcpus(int *cpu, int *sibcpu, int *corecpu)
+{
+	cpu_set_t	mask;
+	char		buf[256], pkg[64], pkg2[64], core[64], core2[64];
+	int		i, j, ncpu = sysconf(_SC_NPROCESSORS_CONF);
+
+	*cpu = *sibcpu = *corecpu = -1;
+
+	if (sched_getaffinity(0, sizeof mask, &mask) == -1) {
+		perror("sched_getaffinity");
+		return -1;
+	}
+
+	// search first CPU that has an SMT sibling
+	//
+	for (i=0; i < ncpu && *sibcpu == -1; i++) {
+		if (!CPU_ISSET(i, &mask))
+			continue;
+
+		if (*cpu == -1)
+			*cpu = i;
+
+		if (cputopo(i, "thread_siblings_list", buf, sizeof buf) == -1)
+			continue;
+
+		for (j=0; j < ncpu; j++) {
+			if (j == i || !CPU_ISSET(j, &mask))
+				continue;
+
+			if (cpuinlist(j, buf)) {
+				*cpu    = i;
+				*sibcpu = j;
 				break;
 			}
-		   default:
-			fprintf(stderr, "Usage: usecpu [cpusec] [cpuperc%]\n");
-			fprintf(stderr, "     cpusec   - number of CPU seconds "
-			                "to consume in total "
-			                "(default: infinite)\n");
-			fprintf(stderr, "     cpuperc%% - percentage of CPU "
-			                "utilization (default: 100%, "
-					"max 100%)\n");
+		}
+	}
+
+	if (*cpu == -1)
+		return -1;
+
+	// search CPU on another core, preferably in the same package
+	//
+	if (cputopo(*cpu, "physical_package_id", pkg,  sizeof pkg)  == -1 ||
+	    cputopo(*cpu, "core_id",             core, sizeof core) == -1)
+		pkg[0] = core[0] = '\0';
+
+	for (i=0; i < ncpu; i++) {
+		if (i == *cpu || i == *sibcpu || !CPU_ISSET(i, &mask))
+			continue;
+
+		if (cputopo(i, "physical_package_id", pkg2,  sizeof pkg2) == -1 ||
+		    cputopo(i, "core_id",             core2, sizeof core2) == -1)
+			pkg2[0] = core2[0] = '\0';
+
+		if (strcmp(pkg, pkg2) == 0 && strcmp(core, core2) == 0)
+			continue;		// another sibling of same core
+
+		if (*corecpu == -1 || strcmp(pkg, pkg2) == 0) {
+			*corecpu = i;
+
+			if (strcmp(pkg, pkg2) == 0)
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+** verify if a CPU number occurs in a CPU list like "0-3,8,10-11"
+*/
+static int
+cpuinlist(int cpu, char *list)
+{
+	char	*p = list;
+	long	lo, hi;
+
+	while (*p) {
+		lo = hi = strtol(p, &p, 10);
+
+		if (*p == '-')
+			hi = strtol(p+1, &p, 10);
+
+		if (cpu >= lo && cpu <= hi)
+			return 1;
+
+		if (*p != ',')
+			break;
+		p++;
+	}
+
+	return 0;
+}
+
+/*
+** thread function: pin to CPU and execute kernel until stopped
+*/
+static void *
+smtrun(void *arg)
+{
+	struct smtthread	*st = arg;
+	struct timespec		start, end;
+	cpu_set_t		mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(st->cpu, &mask);
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof mask, &mask))
+		fprintf(stderr, "warning: can't pin thread to cpu %d\n", st->cpu);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (!smtstop) {
+		(void) st->kern->func(&st->state, KBATCH);
+		st->iters += KBATCH;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	st->secs = (end.tv_sec  - start.tv_sec) +
+	           (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	return NULL;
+}
+
+/*
+** run measured kernel on cpu during msec milliseconds, optionally
+** with an aggressor kernel on aggcpu, and return the iteration rate
+** of the measured kernel (iterations per second)
+*/
+static double
+smtmeasure(struct kernel *meas, int cpu, struct kernel *agg, int aggcpu,
+	   long msec)
+{
+	struct smtthread	mt, at;
+	struct timespec		ts;
+
+	memset(&mt, 0, sizeof mt);
+	memset(&at, 0, sizeof at);
+
+	mt.kern = meas;
+	mt.cpu  = cpu;
+	kerninit(meas, &mt.state);
+
+	smtstop = 0;
+
+	// start aggressor first to let it reach its steady state
+	//
+	if (agg) {
+		at.kern = agg;
+		at.cpu  = aggcpu;
+		kerninit(agg, &at.state);
+
+		if ( pthread_create(&at.tid, NULL, smtrun, &at) ) {
+			fprintf(stderr, "can't create aggressor thread\n");
 			exit(1);
 		}
+
+		ts.tv_sec  = SMTWARMUP / 1000;
+		ts.tv_nsec = SMTWARMUP % 1000 * 1000000;
+		nanosleep(&ts, NULL);
+	}
+
+	if ( pthread_create(&mt.tid, NULL, smtrun, &mt) ) {
+		fprintf(stderr, "can't create measurement thread\n");
+		exit(1);
+	}
+
+	ts.tv_sec  = msec / 1000;
+	ts.tv_nsec = msec % 1000 * 1000000;
+	nanosleep(&ts, NULL);
+
+	smtstop = 1;
+
+	pthread_join(mt.tid, NULL);
+	kernfree(&mt.state);
+
+	if (agg) {
+		pthread_join(at.tid, NULL);
+		kernfree(&at.state);
 	}
 
-	// define signal handler
-	(void) signal(SIGVTALRM, checkutil);
+	return mt.secs > 0 ? mt.iters / mt.secs : 0;
+}
+
+/*
+** SMT interference mode: measure every combination of kernels
+** with the aggressor on the SMT sibling and on a separate core,
+** and print the slowdown matrix
+*/
+static void
+smtmode(char *kernlist, long msec)
+{
+	struct kernel	*ks[MAXKERN];
+	double		base[MAXKERN], sib[MAXKERN][MAXKERN],
+			sep[MAXKERN][MAXKERN];
+	int		nk = 0, i, j, cpu, sibcpu, corecpu;
+	char		*p, *list;
+
+	// determine kernels to be used
+	//
+	if (kernlist) {
+		list = strdup(kernlist);
 
-	// oneshot signal with 100% consumption?
-	if (cpuperc == 100) {
-		if (totalcpusec > 0) {
-			itv.it_value.tv_sec = totalcpusec;
-			(void) setitimer(ITIMER_VIRTUAL, &itv,
-						(struct itimerval *)0);
+		for (p = strtok(list, ","); p; p = strtok(NULL, ",")) {
+			if (nk == MAXKERN || (ks[nk] = kernfind(p)) == NULL) {
+				fprintf(stderr, "invalid kernel: %s "
+				        "(valid: int, fp, avx, mem)\n", p);
+				exit(1);
+			}
+			nk++;
 		}
+
+		free(list);
 	} else {
-		// multishot signal with less than 100% consumption?
-		itv.it_interval.tv_sec  = 0;
-		itv.it_interval.tv_usec = 10000*cpuperc;
+		for (nk=0; nk < MAXKERN; nk++)
+			ks[nk] = &kernels[nk];
+	}
+
+	// determine CPUs to be used
+	//
+	if (smtcpus(&cpu, &sibcpu, &corecpu) == -1) {
+		fprintf(stderr, "no usable CPUs found\n");
+		exit(1);
+	}
+
+	if (sibcpu == -1 && corecpu == -1) {
+		fprintf(stderr, "at least two usable CPUs required\n");
+		exit(1);
+	}
+
+	printf("measured on cpu %d, aggressor on ", cpu);
+
+	if (sibcpu != -1)
+		printf("SMT sibling cpu %d", sibcpu);
+	else
+		printf("SMT sibling (none: SMT not active)");
+
+	if (corecpu != -1)
+		printf(" and on separate core cpu %d\n", corecpu);
+	else
+		printf(" (no separate core available)\n");
 
-		itv.it_value.tv_sec     = 0;
-		itv.it_value.tv_usec    = 10000*cpuperc;
+	fflush(stdout);
 
-		(void) setitimer(ITIMER_VIRTUAL, &itv, (struct itimerval *)0);
+	// measure every kernel alone and with every aggressor
+	//
+	for (i=0; i < nk; i++) {
+		base[i] = smtmeasure(ks[i], cpu, NULL, -1, msec);
+
+		for (j=0; j < nk; j++) {
+			sib[i][j] = sibcpu == -1 ? 0 :
+				smtmeasure(ks[i], cpu, ks[j], sibcpu,  msec);
+
+			sep[i][j] = corecpu == -1 ? 0 :
+				smtmeasure(ks[i], cpu, ks[j], corecpu, msec);
+		}
 	}
 
-	clock_gettime(CLOCK_REALTIME, &curtime);
+	// print slowdown matrix
+	//
+	printf("\nslowdown of measured kernel (row) by aggressor "
+	       "(column) as sibling / separate core\n\n");
+
+	printf("%-8s %14s", "measured", "alone(Mit/s)");
+
+	for (j=0; j < nk; j++)
+		printf("  %12s", ks[j]->name);
+
+	printf("\n");
+
+	for (i=0; i < nk; i++) {
+		printf("%-8s %14.1f", ks[i]->name, base[i] / 1e6);
+
+		for (j=0; j < nk; j++) {
+			printf("  ");
+			smtfactor(base[i], sib[i][j]);
+			printf(" /");
+			smtfactor(base[i], sep[i][j]);
+		}
+
+		printf("\n");
+	}
+}
+
+/*
+** print one slowdown factor (or dashes if not measured)
+*/
+static void
+smtfactor(double base, double rate)
+{
+	if (rate > 0)
+		printf("%5.2f", base / rate);
+	else
+		printf("%5s", "-");
+}
+
+/*
+** current time of a clock in nanoseconds
+*/
+static unsigned long long
+nsecs(clockid_t clk)
+{
+	struct timespec	ts;
+
+	clock_gettime(clk, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+** random number from an exponential distribution with given mean
+*/
+static double
+randexp(double mean, unsigned short xsubi[3])
+{
+	return -mean * log(1.0 - erand48(xsubi));
+}
+
+/*
+** add a value (nanoseconds) to a latency histogram with buckets
+** that are logarithmic per power of two and linear within
+*/
+static void
+histadd(struct histo *h, unsigned long long v)
+{
+	int	e;
+
+	h->count++;
+	h->sum += v;
+
+	if (v > h->max)
+		h->max = v;
+
+	if (v < (1 << HSUBBITS)) {
+		h->bucket[v]++;
+		return;
+	}
+
+	e = 63 - __builtin_clzll(v) - HSUBBITS;
+
+	if (e >= HBUCKETS / (1 << HSUBBITS) - 1)
+		e  = HBUCKETS / (1 << HSUBBITS) - 2;
+
+	h->bucket[((e + 1) << HSUBBITS) + (int)(v >> e) - (1 << HSUBBITS)]++;
+}
+
+/*
+** determine the value of a percentile from a histogram
+*/
+static unsigned long long
+histperc(struct histo *h, double perc)
+{
+	unsigned long long	n = 0, want = ceil(h->count * perc / 100);
+	int			i, e, m;
+
+	if (want == 0)
+		want = 1;
+
+	for (i=0; i < HBUCKETS; i++) {
+		n += h->bucket[i];
+
+		if (n >= want)
+			break;
+	}
+
+	if (i < (1 << HSUBBITS) || i == HBUCKETS)
+		return (unsigned long long)i < h->max ? i : h->max;
+
+	e = (i >> HSUBBITS) - 1;
+	m = (i & ((1 << HSUBBITS) - 1)) + (1 << HSUBBITS);
+
+	// middle of the bucket, but never beyond the maximum seen
+	//
+	n = ((unsigned long long)m << e) + ((1ULL << e) >> 1);
+
+	return n < h->max ? n : h->max;
+}
+
+static void
+histmerge(struct histo *to, struct histo *from)
+{
+	int	i;
+
+	to->count += from->count;
+	to->sum   += from->sum;
+
+	if (from->max > to->max)
+		to->max = from->max;
+
+	for (i=0; i < HBUCKETS; i++)
+		to->bucket[i] += from->bucket[i];
+}
+
+/*
+** show percentiles of a histogram in microseconds
+*/
+static void
+histshow(char *label, struct histo *h)
+{
+	printf("%-14s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", label,
+		histperc(h, 50)   / 1e3, histperc(h, 90) / 1e3,
+		histperc(h, 99)   / 1e3, histperc(h, 99.9) / 1e3,
+		h->max / 1e3, h->count ? h->sum / 1e3 / h->count : 0.0);
+}
+
+/*
+** worker thread: take jobs from the queue and burn the requested
+** amount of CPU time for every job
+*/
+static void *
+arrwork(void *arg)
+{
+	struct worker		*w = arg;
+	struct job		job;
+	unsigned long long	start, cpustart, now, iters, checked = 0;
+
+	while (1) {
+		pthread_mutex_lock(&jq.lock);
+
+		while (jq.head == jq.tail && !jq.stop)
+			pthread_cond_wait(&jq.cond, &jq.lock);
+
+		if (jq.stop) {
+			pthread_mutex_unlock(&jq.lock);
+			break;
+		}
+
+		job = jq.jobs[jq.head++ % MAXQUEUE];
+
+		pthread_mutex_unlock(&jq.lock);
+
+		start = nsecs(CLOCK_MONOTONIC);
+		histadd(&w->qdelay, start > job.arrival ?
+					start - job.arrival : 0);
+
+		cpustart = nsecs(CLOCK_THREAD_CPUTIME_ID);
+		iters    = 0;
+
+		do {
+			(void) loadkern->func(&w->state, SVCBATCH);
+			iters += SVCBATCH;
+			now = nsecs(CLOCK_THREAD_CPUTIME_ID);
+
+			// verify budget after every batch of CPU time
+			//
+			if (now - checked >= KBATCHNSEC) {
+				checked = now;
+				budgetcheck();
+			}
+		} while (now - cpustart < job.demand && !jq.stop);
+
+		__atomic_add_fetch(&jobcpunsec, now - cpustart,
+							__ATOMIC_RELAXED);
+		__atomic_add_fetch(&kiters, iters, __ATOMIC_RELAXED);
+
+		if (now - cpustart < job.demand) {	// stopped halfway
+			__atomic_add_fetch(&jobsaborted, 1, __ATOMIC_RELAXED);
+			break;
+		}
+
+		histadd(&w->resp, nsecs(CLOCK_MONOTONIC) - job.arrival);
+		markcpu();
+
+		__atomic_add_fetch(&jobsdone, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+** signal handler for SIGINT, SIGTERM and SIGUSR1 (budget reached)
+*/
+static void
+stopsig(int sig)
+{
+	if (!interrupted)
+		interrupted = sig;
+}
+
+/*
+** catch the signals that stop the load and block them for the
+** current thread (and the threads it creates hereafter)
+** the original signal mask is returned via oset
+*/
+static void
+stopsignals(sigset_t *oset)
+{
+	struct sigaction	sa;
+	sigset_t		set;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = stopsig;
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGUSR1);
+
+	mainthread = pthread_self();
+	pthread_sigmask(SIG_BLOCK, &set, oset);
+}
+
+/*
+** verify if the CPU consumption of all threads together has reached
+** the budget; if so, let the main thread stop the load
+*/
+static void
+budgetcheck(void)
+{
+	if (budgetnsec && !loadstop &&
+	    nsecs(CLOCK_PROCESS_CPUTIME_ID) >= budgetnsec) {
+		loadstop = 1;
+		pthread_kill(mainthread, SIGUSR1);
+	}
+}
+
+/*
+** show the consumed CPU time of all threads versus the requested
+** CPU time and the reason of stopping
+*/
+static void
+budgetsummary(unsigned long long wallstart, int nthreads)
+{
+	double	cpusec  = nsecs(CLOCK_PROCESS_CPUTIME_ID) / 1e9,
+		wallsec = (nsecs(CLOCK_MONOTONIC) - wallstart) / 1e9;
+
+	printf("\n%.3f CPU seconds consumed", cpusec);
+
+	if (totalcpusec)
+		printf(" of %llu requested (%.2f%%)", totalcpusec,
+					cpusec * 100 / totalcpusec);
+
+	printf(" by %d thread%s in %.1f s (%.1f%% of one CPU), ",
+		nthreads, nthreads == 1 ? "" : "s", wallsec,
+		wallsec > 0 ? cpusec * 100 / wallsec : 0.0);
+
+	switch (interrupted) {
+	   case SIGUSR1:
+		printf("CPU budget reached\n");
+		break;
+	   case SIGINT:
+		printf("interrupted (SIGINT)\n");
+		break;
+	   case SIGTERM:
+		printf("terminated (SIGTERM)\n");
+		break;
+	   default:
+		printf("stopped\n");
+	}
+
+	fflush(stdout);
+}
+
+/*
+** parse "key:value[,extra]" and return value and extra (or NULL)
+*/
+static double
+arrparse(char *arg, char *key, char **extra)
+{
+	int	klen = strlen(key);
+	char	*p;
+	double	val;
+
+	if (strncmp(arg, key, klen) || arg[klen] != ':') {
+		fprintf(stderr, "expected %s:<value> instead of %s\n",
+								key, arg);
+		exit(1);
+	}
+
+	val = strtod(arg+klen+1, &p);
+
+	if (val <= 0 || (*p && *p != ',')) {
+		fprintf(stderr, "invalid %s value: %s\n", key, arg+klen+1);
+		exit(1);
+	}
+
+	*extra = *p == ',' ? p+1 : NULL;
+
+	return val;
+}
+
+/*
+** open hardware counters for L1D read misses and last level cache
+** misses of all (current and future) threads of this process
+** silently ignored when not available
+*/
+static void
+perfopen(void)
+{
+	struct perf_event_attr	pe[PERF_NUM];
+	int			i;
+
+	memset(pe, 0, sizeof pe);
+
+	pe[PERF_L1DMISS].type   = PERF_TYPE_HW_CACHE;
+	pe[PERF_L1DMISS].config = PERF_COUNT_HW_CACHE_L1D |
+				  PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				  PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+
+	pe[PERF_LLCMISS].type   = PERF_TYPE_HARDWARE;
+	pe[PERF_LLCMISS].config = PERF_COUNT_HW_CACHE_MISSES;
+
+	for (i=0; i < PERF_NUM; i++) {
+		pe[i].size           = sizeof pe[i];
+		pe[i].inherit        = 1;
+		pe[i].exclude_kernel = 1;
+		pe[i].exclude_hv     = 1;
+
+		perffd[i] = syscall(SYS_perf_event_open, &pe[i], 0, -1, -1, 0);
+	}
+}
+
+/*
+** read the current values of the hardware counters
+** (-1 for an unavailable counter)
+*/
+static void
+perfread(unsigned long long val[])
+{
+	int	i;
+
+	for (i=0; i < PERF_NUM; i++) {
+		if (perffd[i] == -1 ||
+		    read(perffd[i], &val[i], sizeof val[i]) != sizeof val[i])
+			val[i] = -1;
+	}
+}
+
+/*
+** show kernel iterations and the misses per iteration (i.e. per
+** memory access for the mem kernel) during an interval
+*/
+static void
+perfshow(char *sep, unsigned long long delta[], unsigned long long iters)
+{
+	printf("%s%.1fM it", sep, iters / 1e6);
+
+	if (delta[PERF_L1DMISS] == -1ULL && delta[PERF_LLCMISS] == -1ULL) {
+		printf(" (no hardware counters)");
+		return;
+	}
+
+	printf(", misses/it:");
+
+	if (delta[PERF_L1DMISS] != -1ULL && iters)
+		printf(" L1D %.1f%%", delta[PERF_L1DMISS] * 100.0 / iters);
+
+	if (delta[PERF_LLCMISS] != -1ULL && iters)
+		printf(" LLC %.1f%%", delta[PERF_LLCMISS] * 100.0 / iters);
+}
+
+/*
+** at exit: show totals of the load kernel
+*/
+static void
+kernsummary(void)
+{
+	unsigned long long	val[PERF_NUM];
+
+	perfread(val);
+
+	printf("kernel %s", loadkern->name);
+
+	if (loadkern->func == kern_mem)
+		printf(" (working set %llu KiB, %s, %u%% to working set)",
+			memparam.size / 1024,
+			memparam.pattern == MEMRAND ? "rand" :
+			memparam.pattern == MEMSEQ  ? "seq"  : "stride",
+			memparam.missperc);
+
+	perfshow(": ", val, kiters);
+	printf("\n");
+}
+
+/*
+** register the CPU on which the calling thread currently runs
+** (only written when not yet registered to avoid cache line bouncing)
+*/
+static void
+markcpu(void)
+{
+	int	cpu = sched_getcpu();
+
+	if (cpu < 0 || cpu >= MAXCPU)
+		return;
+
+	if ( !(cpuseen[cpu/64] & (1ULL << cpu%64)) )
+		__atomic_or_fetch(&cpuseen[cpu/64], 1ULL << cpu%64,
+							__ATOMIC_RELAXED);
+}
+
+/*
+** read a numeric value from a sysfs file
+** returns -1 if not available
+*/
+static int
+sysfsnum(char *path, unsigned long long *val)
+{
+	FILE	*fp;
+	int	rv;
+
+	if ( (fp = fopen(path, "r")) == NULL)
+		return -1;
+
+	rv = fscanf(fp, "%llu", val) == 1 ? 0 : -1;
+
+	fclose(fp);
+
+	return rv;
+}
+
+/*
+** add the current frequency of a CPU to its frequency sum
+*/
+static void
+freqsample(int cpu, struct cpustat *cs)
+{
+	char			path[128];
+	unsigned long long	khz;
+
+	snprintf(path, sizeof path,
+		"/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+
+	if (sysfsnum(path, &khz) == 0) {
+		cs->freqsum += khz;
+		cs->freqcnt++;
+	}
+}
+
+/*
+** read the cumulative cpuidle counters of a CPU
+*/
+static void
+idlesample(int cpu, struct cpustat *cs)
+{
+	char	path[128];
+	FILE	*fp;
+	int	i;
+
+	for (i=0; i < MAXCSTATE; i++) {
+		snprintf(path, sizeof path,
+			"/sys/devices/system/cpu/cpu%d/cpuidle/state%d/usage",
+			cpu, i);
+
+		if (sysfsnum(path, &cs->usage[i]) == -1)
+			break;
+
+		snprintf(path, sizeof path,
+			"/sys/devices/system/cpu/cpu%d/cpuidle/state%d/time",
+			cpu, i);
+
+		if (sysfsnum(path, &cs->time[i]) == -1)
+			break;
+
+		// gather state names once
+		//
+		if (cstatename[i][0] == '\0') {
+			snprintf(path, sizeof path,
+			   "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/name",
+			   cpu, i);
+
+			if ( (fp = fopen(path, "r")) ) {
+				if (fscanf(fp, "%15s", cstatename[i]) != 1)
+					strcpy(cstatename[i], "?");
+				fclose(fp);
+			}
+		}
+	}
+
+	cs->nstates = i;
+}
+
+/*
+** reporter thread: every interval show utilization, mean frequency
+** and C-state residency of the CPUs that were used by the load
+*/
+static void *
+reporter(void *arg)
+{
+	long			interval = (long)arg, i;
+	int			ncpu, cpu, j, nused;
+	struct cpustat		*prev, *cur;
+	struct timespec		ts;
+	unsigned long long	seen[MAXCPU/64], wall, prevwall, startwall, cputime,
+				prevcpu, freqsum, freqcnt, entries,
+				idle[MAXCSTATE], pcur[PERF_NUM],
+				pprev[PERF_NUM], it, previt = 0;
+	cpu_set_t		mask;
+	char			cpulist[64];
+
+	ncpu = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (ncpu > MAXCPU)
+		ncpu = MAXCPU;
+
+	if (sched_getaffinity(0, sizeof mask, &mask) == -1)
+		CPU_ZERO(&mask);
+
+	prev = calloc(ncpu, sizeof *prev);
+	cur  = calloc(ncpu, sizeof *cur);
+
+	for (cpu=0; cpu < ncpu; cpu++)
+		if (CPU_ISSET(cpu, &mask))
+			idlesample(cpu, &prev[cpu]);
+
+	prevwall = startwall = nsecs(CLOCK_MONOTONIC);
+	prevcpu  = nsecs(CLOCK_PROCESS_CPUTIME_ID);
+	perfread(pprev);
+
+	printf("%8s %7s %6s %9s  %s\n", "time", "cpus", "util%", "freqMHz",
+						"C-state residency");
+	fflush(stdout);
+
+	ts.tv_sec  = interval * 1000 / FREQSAMPLES / 1000;
+	ts.tv_nsec = interval * 1000 / FREQSAMPLES % 1000 * 1000000;
+
+	for (EVER) {
+		// sample frequencies a number of times during the interval
+		//
+		for (i=0; i < FREQSAMPLES; i++) {
+			nanosleep(&ts, NULL);
+
+			for (cpu=0; cpu < ncpu; cpu++)
+				if (CPU_ISSET(cpu, &mask))
+					freqsample(cpu, &cur[cpu]);
+		}
+
+		for (cpu=0; cpu < ncpu; cpu++)
+			if (CPU_ISSET(cpu, &mask))
+				idlesample(cpu, &cur[cpu]);
+
+		wall    = nsecs(CLOCK_MONOTONIC);
+		cputime = nsecs(CLOCK_PROCESS_CPUTIME_ID);
+
+		for (j=0; j < MAXCPU/64; j++)
+			seen[j] = __atomic_exchange_n(&cpuseen[j], 0,
+							__ATOMIC_RELAXED);
+
+		// accumulate counters of the CPUs that were used
+		//
+		freqsum = freqcnt = entries = nused = 0;
+		memset(idle, 0, sizeof idle);
+		cpulist[0] = '\0';
+
+		for (cpu=0; cpu < ncpu; cpu++) {
+			if ( !(seen[cpu/64] & (1ULL << cpu%64)) )
+				continue;
+
+			nused++;
+
+			if (strlen(cpulist) < sizeof cpulist - 8)
+				snprintf(cpulist+strlen(cpulist),
+					sizeof cpulist - strlen(cpulist),
+					"%s%d", nused > 1 ? "," : "", cpu);
+
+			freqsum += cur[cpu].freqsum;
+			freqcnt += cur[cpu].freqcnt;
+
+			for (j=0; j < cur[cpu].nstates &&
+			          j < prev[cpu].nstates; j++) {
+				idle[j]  += cur[cpu].time[j]  - prev[cpu].time[j];
+				entries  += cur[cpu].usage[j] - prev[cpu].usage[j];
+			}
+		}
+
+		printf("%8.1f %7s %6.1f ", (wall - startwall) / 1e9,
+			nused ? cpulist : "-",
+			(cputime - prevcpu) * 100.0 / (wall - prevwall));
+
+		if (freqcnt)
+			printf("%9.0f", freqsum / 1000.0 / freqcnt);
+		else
+			printf("%9s", "-");
+
+		if (nused && cstatename[0][0])
+			printf(" ");
+
+		for (j=0; nused && j < MAXCSTATE && cstatename[j][0]; j++)
+			printf(" %s %.1f%%", cstatename[j], idle[j] * 1000 *
+				100.0 / ((wall - prevwall) * nused));
+
+		if (nused && cstatename[0][0])
+			printf("  (%.0f entries/s)",
+				entries * 1e9 / (wall - prevwall));
+
+		// cache behaviour of the load kernel
+		//
+		if (loadkern) {
+			perfread(pcur);
+			it = __atomic_load_n(&kiters, __ATOMIC_RELAXED);
+
+			for (j=0; j < PERF_NUM; j++) {
+				if (pcur[j] != -1ULL && pprev[j] != -1ULL)
+					pprev[j] = pcur[j] - pprev[j];
+				else
+					pprev[j] = -1;
+			}
+
+			perfshow("  ", pprev, it - previt);
+
+			memcpy(pprev, pcur, sizeof pprev);
+			previt = it;
+		}
+
+		printf("\n");
+		fflush(stdout);
+
+		// current counters become previous counters
+		//
+		for (cpu=0; cpu < ncpu; cpu++) {
+			prev[cpu] = cur[cpu];
+			cur[cpu].freqsum = cur[cpu].freqcnt = 0;
+		}
+
+		prevwall = wall;
+		prevcpu  = cputime;
+	}
+
+	return NULL;
+}
+
+/*
+** start the reporter thread
+*/
+static void
+startreporter(long interval)
+{
+	pthread_t	tid;
+
+	if ( pthread_create(&tid, NULL, reporter, (void *)interval) ) {
+		fprintf(stderr, "can't create reporter thread\n");
+		exit(1);
+	}
+}
+
+/*
+** arrival-driven mode: generate jobs in a Poisson (or bursty) process
+** and let them be executed by a pool of worker threads until the
+** requested CPU time has been consumed
+*/
+static void
+arrivalmode(char *arrspec, char *svcspec, int nthreads, long interval)
+{
+	struct worker		*workers;
+	struct histo		*qdelay, *resp;
+	struct timespec		ts;
+	sigset_t		oset;
+	unsigned short		xsubi[3];
+	unsigned long long	next, now, start, demand;
+	double			rate, burst = 1, svcmean, runsec;
+	char			*extra, *dist = "fixed";
+	long			i, n;
+
+	// interpret arrival and service specification
+	//
+	rate = arrparse(arrspec, "rate", &extra);
+
+	if (extra)
+		burst = arrparse(extra, "burst", &extra);
+
+	if (extra || burst < 1) {
+		fprintf(stderr, "invalid arrivals: %s\n", arrspec);
+		exit(1);
+	}
+
+	svcmean = arrparse(svcspec, "mean", &extra) * 1000;	// nsec
+
+	if (extra)
+		dist = extra;
+
+	if (strcmp(dist, "fixed") && strcmp(dist, "exp") &&
+	    strcmp(dist, "uniform")) {
+		fprintf(stderr, "invalid service distribution: %s "
+		                "(valid: fixed, exp, uniform)\n", dist);
+		exit(1);
+	}
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	// stop generating when interrupted or when the budget has
+	// been consumed (signals are only handled by this thread)
+	//
+	stopsignals(&oset);
+
+	// start worker pool
+	//
+	if ( (workers = calloc(nthreads, sizeof *workers)) == NULL) {
+		perror("Can't allocate workers");
+		exit(1);
+	}
+
+	for (i=0; i < nthreads; i++) {
+		kerninit(loadkern, &workers[i].state);
+
+		if ( pthread_create(&workers[i].tid, NULL, arrwork,
+							&workers[i]) ) {
+			fprintf(stderr, "can't create worker thread\n");
+			exit(1);
+		}
+	}
+
+	printf("arrivals %.1f/s in bursts of %.1f, service %.1f us (%s), "
+	       "%d threads, offered load %.1f%% of one CPU\n",
+		rate, burst, svcmean / 1000, dist, nthreads,
+		rate * svcmean / 1e7);
+	fflush(stdout);
+
+	if (interval)
+		startreporter(interval);
+
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+	xsubi[0] = getpid();
+	xsubi[1] = time(NULL);
+	xsubi[2] = 0x330e;
+
+	start = next = nsecs(CLOCK_MONOTONIC);
+
+	// generate arrivals: bursts arrive in a Poisson process with
+	// rate/burst per second and contain a geometrically distributed
+	// number of jobs with mean burst (i.e. rate jobs per second)
+	//
+	while (!interrupted) {
+		budgetcheck();
+
+		if (loadstop)
+			break;
+
+		next += randexp(1e9 * burst / rate, xsubi);
+
+		ts.tv_sec  = next / 1000000000;
+		ts.tv_nsec = next % 1000000000;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&ts, NULL) == EINTR) {
+			if (interrupted)
+				break;
+		}
+
+		if (interrupted)
+			break;
+
+		n = 1;
+
+		while (erand48(xsubi) > 1 / burst)
+			n++;
+
+		pthread_mutex_lock(&jq.lock);
+
+		for (i=0; i < n; i++) {
+			if (strcmp(dist, "exp") == 0)
+				demand = randexp(svcmean, xsubi);
+			else if (strcmp(dist, "uniform") == 0)
+				demand = 2 * svcmean * erand48(xsubi);
+			else
+				demand = svcmean;
+
+			if (jq.tail - jq.head >= MAXQUEUE) {
+				jobsdropped++;
+				continue;
+			}
+
+			jq.jobs[jq.tail % MAXQUEUE].arrival = next;
+			jq.jobs[jq.tail % MAXQUEUE].demand  = demand;
+			jq.tail++;
+		}
+
+		pthread_cond_broadcast(&jq.cond);
+		pthread_mutex_unlock(&jq.lock);
+	}
+
+	// stop worker pool (jobs still queued are not executed and
+	// jobs in progress are aborted)
+	//
+	pthread_mutex_lock(&jq.lock);
+	jq.stop = 1;
+	n = jq.tail - jq.head;
+	pthread_cond_broadcast(&jq.cond);
+	pthread_mutex_unlock(&jq.lock);
+
+	qdelay = calloc(1, sizeof *qdelay);
+	resp   = calloc(1, sizeof *resp);
+
+	for (i=0; i < nthreads; i++) {
+		pthread_join(workers[i].tid, NULL);
+		histmerge(qdelay, &workers[i].qdelay);
+		histmerge(resp,   &workers[i].resp);
+	}
+
+	now    = nsecs(CLOCK_MONOTONIC);
+	runsec = (now - start) / 1e9;
+
+	// report
+	//
+	budgetsummary(start, nthreads);
+
+	printf("%llu jobs completed in %.1f s (%.1f/s), %llu aborted, "
+	       "%ld not started, %llu dropped (queue full)\n",
+		jobsdone, runsec, runsec > 0 ? jobsdone / runsec : 0.0,
+		jobsaborted, n, jobsdropped);
+
+	printf("%.3f CPU seconds consumed by jobs (%.1f%% of one CPU)\n\n",
+		jobcpunsec / 1e9,
+		runsec > 0 ? jobcpunsec / 1e7 / runsec : 0.0);
+
+	printf("%-14s %9s %9s %9s %9s %9s %9s\n", "usec",
+		"p50", "p90", "p99", "p99.9", "max", "mean");
+
+	histshow("queue delay", qdelay);
+	histshow("response time", resp);
+}
+
+/*
+** empty kernel for the default load
+*/
+static unsigned long long
+kern_spin(struct kstate *ks, unsigned long n)
+{
+	while (n--)
+		__asm__ volatile ("");
+
+	return 0;
+}
+
+/*
+** determine the number of kernel iterations that take about
+** KBATCHNSEC of CPU time
+*/
+static unsigned long
+kerncalibrate(unsigned long long (*func)(struct kstate *, unsigned long),
+	      struct kstate *ks)
+{
+	unsigned long long	start = nsecs(CLOCK_THREAD_CPUTIME_ID), spent;
+	unsigned long		iters = 0;
+
+	do {
+		(void) func(ks, KBATCH);
+		iters += KBATCH;
+		spent  = nsecs(CLOCK_THREAD_CPUTIME_ID) - start;
+	} while (spent < KCALIBRATE);
+
+	__atomic_add_fetch(&kiters, iters, __ATOMIC_RELAXED);
+
+	iters = iters * KBATCHNSEC / spent;
+
+	return iters ? iters : 1;
+}
+
+/*
+** load thread: consume the requested percentage of every period of
+** CPU time and sleep for the rest of the period, until stopped
+*/
+static void *
+dutyrun(void *arg)
+{
+	struct loadthread	*lt = arg;
+	unsigned long long	(*func)(struct kstate *, unsigned long);
+	unsigned long long	period, cpustart, busy = cpuperc * PERIOD / 100;
+	unsigned long		batch;
+	struct timespec		ts;
+
+	func  = loadkern ? loadkern->func : kern_spin;
+	batch = kerncalibrate(func, &lt->state);
+
+	period   = nsecs(CLOCK_MONOTONIC);
+	cpustart = nsecs(CLOCK_THREAD_CPUTIME_ID);
+
+	while (!loadstop) {
+		(void) func(&lt->state, batch);
+
+		__atomic_add_fetch(&kiters, batch, __ATOMIC_RELAXED);
+		markcpu();
+		budgetcheck();
+
+		if (cpuperc == 100 ||
+		    nsecs(CLOCK_THREAD_CPUTIME_ID) - cpustart < busy)
+			continue;
+
+		// sleep until the end of the period unless stopped
+		//
+		period += PERIOD;
+
+		ts.tv_sec  = period / 1000000000;
+		ts.tv_nsec = period % 1000000000;
+
+		pthread_mutex_lock(&stoplock);
+
+		while (!loadstop &&
+		       pthread_cond_timedwait(&stopcond, &stoplock, &ts) == 0)
+			;
+
+		pthread_mutex_unlock(&stoplock);
+
+		// period overrun (e.g. CPU not available): start over
+		//
+		if (nsecs(CLOCK_MONOTONIC) > period + PERIOD)
+			period = nsecs(CLOCK_MONOTONIC);
+
+		cpustart = nsecs(CLOCK_THREAD_CPUTIME_ID);
+	}
+
+	return NULL;
+}
+
+/*
+** default mode: run the duty-cycle load with a number of threads
+** until the CPU budget is consumed or a stop signal arrives
+*/
+static void
+dutymode(int nthreads, long interval)
+{
+	struct loadthread	*lts;
+	pthread_condattr_t	attr;
+	sigset_t		oset;
+	unsigned long long	start = nsecs(CLOCK_MONOTONIC);
+	int			i;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&stopcond, &attr);
+
+	stopsignals(&oset);
+
+	if (loadkern)
+		perfopen();
+
+	if ( (lts = calloc(nthreads, sizeof *lts)) == NULL) {
+		perror("Can't allocate load threads");
+		exit(1);
+	}
+
+	for (i=0; i < nthreads; i++) {
+		if (loadkern)
+			kerninit(loadkern, &lts[i].state);
+
+		if ( pthread_create(&lts[i].tid, NULL, dutyrun, &lts[i]) ) {
+			fprintf(stderr, "can't create load thread\n");
+			exit(1);
+		}
+	}
+
+	if (interval)
+		startreporter(interval);
+
+	// wait for a stop signal with the signals unblocked
+	//
+	while (!interrupted)
+		sigsuspend(&oset);
+
+	pthread_mutex_lock(&stoplock);
+	loadstop = 1;
+	pthread_cond_broadcast(&stopcond);
+	pthread_mutex_unlock(&stoplock);
+
+	for (i=0; i < nthreads; i++)
+		pthread_join(lts[i].tid, NULL);
+
+	budgetsummary(start, nthreads);
+
+	if (loadkern)
+		kernsummary();
+}
+
+int
+main(int argc, char *argv[])
+{
+	int			i, c, smt = 0, nthreads = 0;
+	unsigned long		val;
+	long			smtmsec = 1000;
+	long			interval = 0;
+	char			*p, *smtkernels = NULL,
+				*arrivals = NULL, *service = NULL;
+
+	static struct option	longopts[] = {
+		{ "smt",	optional_argument,	NULL,	's' },
+		{ "smt-msec",	required_argument,	NULL,	'm' },
+		{ "arrivals",	required_argument,	NULL,	'a' },
+		{ "service",	required_argument,	NULL,	'S' },
+		{ "threads",	required_argument,	NULL,	't' },
+		{ "interval",	required_argument,	NULL,	'i' },
+		{ "kernel",	required_argument,	NULL,	'k' },
+		{ 0,		0,			NULL,	0   },
+	};
+
+	// check all flags
+	while ( (c = getopt_long(argc, argv, "", longopts, NULL)) != EOF) {
+		switch (c) {
+		   case 's':		// SMT interference measurement
+			smt = 1;
+			smtkernels = optarg;
+			break;
+		   case 'm':		// duration of one SMT measurement
+			smtmsec = strtol(optarg, &p, 10);
+
+			if (*p || smtmsec <= 0) {
+				fprintf(stderr, "invalid msec: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		   case 'a':		// job arrival process
+			arrivals = optarg;
+			break;
+		   case 'S':		// job service demand
+			service = optarg;
+			break;
+		   case 't':		// size of worker pool
+			nthreads = strtol(optarg, &p, 10);
+
+			if (*p || nthreads <= 0) {
+				fprintf(stderr, "invalid threads: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		   case 'i':		// reporting interval
+			interval = strtol(optarg, &p, 10);
+
+			if (*p || interval <= 0) {
+				fprintf(stderr, "invalid interval: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		   case 'k':		// load kernel
+			loadkern = kernparse(optarg);
+			break;
+		   default:
+			usage();
+		}
+	}
+
+	if (smt) {
+		smtmode(smtkernels, smtmsec);
+		return 0;
+	}
+
+	if (!arrivals != !service)
+		usage();
+
+	// check all arguments
+	for (i=optind; i < argc; i++) {
+		val = strtol(argv[i], &p, 10);
+
+		switch (*p) {
+		   case '\0':		// CPU seconds to use
+			totalcpusec = val;
+			break;
+		   case '%':		// CPU percentage to force
+			if (val <= 100) {
+				cpuperc = val;
+				break;
+			}
+		   default:
+			usage();
+		}
+	}
+
+	budgetnsec = totalcpusec * 1000000000;
+
+	if (arrivals) {
+		if (cpuperc != 100)
+			usage();
+
+		if (!loadkern)
+			loadkern = &kernels[0];
+
+		perfopen();
+		arrivalmode(arrivals, service, nthreads, interval);
+		return 0;
+	}
 
-	// start wasting cpu-cyles
-	for (EVER);
+	dutymode(nthreads ? nthreads : 1, interval);
 
 	return 0;
 }